@@ -0,0 +1,195 @@
+#ifndef BASE64CODEC_H
+#define BASE64CODEC_H
+
+#include <QByteArray>
+#include <cstring>
+#include <cstdint>
+
+// Streaming base64 decoding for transfers that come back encoded. Bulk work
+// goes to SSE4.1 or AVX2 kernels picked at runtime from the CPU's features,
+// with a portable scalar fallback; line breaks and anything else outside the
+// alphabet are skipped exactly like QByteArray::fromBase64 does.
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct Base64Tables {
+    signed char decode[256];
+    Base64Tables() {
+        memset(decode, -1, sizeof(decode));
+        for (int i = 0; i < 64; ++i) decode[uchar(base64Alphabet[i])] = char(i);
+    }
+};
+static const Base64Tables base64Tables;
+
+// Bulk kernels work on whole groups only and report how much input they
+// consumed; the caller finishes the tail. Decoders stop at the first group
+// holding a character outside the alphabet and may write up to 8 bytes past
+// what they report.
+typedef size_t (*Base64DecodeKernel)(const char* in, size_t n, uchar* out, size_t* written);
+
+static size_t base64DecodeScalar(const char* in, size_t n, uchar* out, size_t* written) {
+    const signed char* table = base64Tables.decode;
+    size_t i = 0, o = 0;
+    for (; i + 4 <= n; i += 4) {
+        int a = table[uchar(in[i])], b = table[uchar(in[i + 1])], c = table[uchar(in[i + 2])], d = table[uchar(in[i + 3])];
+        if ((a | b | c | d) < 0) break;
+        uint32_t v = uint32_t(a) << 18 | uint32_t(b) << 12 | uint32_t(c) << 6 | uint32_t(d);
+        out[o++] = uchar(v >> 16);
+        out[o++] = uchar(v >> 8);
+        out[o++] = uchar(v);
+    }
+    *written = o;
+    return i;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SSHBROWSER_BASE64_X86
+
+// Kernels after Muła and Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions".
+__attribute__((target("ssse3,sse4.1")))
+static size_t base64DecodeSse41(const char* in, size_t n, uchar* out, size_t* written) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2f);
+
+    size_t i = 0, o = 0;
+    for (; i + 16 <= n; i += 16, o += 12) {
+        __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+        __m128i loNibbles = _mm_and_si128(str, mask2F);
+        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        if (!_mm_testz_si128(lo, hi)) break;
+
+        __m128i eq2F = _mm_cmpeq_epi8(str, mask2F);
+        str = _mm_add_epi8(str, _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles)));
+        __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), merged);
+    }
+    size_t tail;
+    i += base64DecodeScalar(in + i, n - i, out + o, &tail);
+    *written = o + tail;
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t base64DecodeAvx2(const char* in, size_t n, uchar* out, size_t* written) {
+    const __m256i lutLo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lutHi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask2F = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0, o = 0;
+    for (; i + 32 <= n; i += 32, o += 24) {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+        __m256i loNibbles = _mm256_and_si256(str, mask2F);
+        __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        if (!_mm256_testz_si256(lo, hi)) break;
+
+        __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+        str = _mm256_add_epi8(str, _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles)));
+        __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, pack);
+        merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + o), merged);
+    }
+    size_t tail;
+    i += base64DecodeSse41(in + i, n - i, out + o, &tail);
+    *written = o + tail;
+    return i;
+}
+#endif
+
+struct Base64Kernels {
+    Base64DecodeKernel decode = base64DecodeScalar;
+    Base64Kernels() {
+#ifdef SSHBROWSER_BASE64_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            decode = base64DecodeAvx2;
+        } else if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3")) {
+            decode = base64DecodeSse41;
+        }
+#endif
+    }
+};
+static const Base64Kernels base64Kernels;
+
+// Incremental decoder: feed it chunks as they come off the channel, split
+// anywhere, then call finish() once for the final partial group.
+class Base64Decoder {
+    QByteArray staging;
+    int pendingBits = 0;
+    uint32_t bits = 0;
+
+public:
+    void decode(const char* in, int n, QByteArray& out) {
+        // Collapse line breaks first so the kernels see long clean runs.
+        staging.resize(n);
+        char* clean = staging.data();
+        int length = 0;
+        const char* end = in + n;
+        while (in < end) {
+            const char* newline = static_cast<const char*>(memchr(in, '\n', end - in));
+            const char* runEnd = newline ? newline : end;
+            if (runEnd > in && runEnd[-1] == '\r') --runEnd;
+            memcpy(clean + length, in, runEnd - in);
+            length += int(runEnd - in);
+            in = newline ? newline + 1 : end;
+        }
+
+        int used = out.size();
+        out.resize(used + (length + 3) / 4 * 3 + 32);
+        uchar* dst = reinterpret_cast<uchar*>(out.data()) + used;
+        uchar* start = dst;
+        const signed char* table = base64Tables.decode;
+        int i = 0;
+        while (i < length) {
+            if (pendingBits == 0) {
+                size_t written;
+                i += int(base64Kernels.decode(clean + i, length - i, dst, &written));
+                dst += written;
+                if (i >= length) break;
+            }
+            // Odd characters and partial groups go through the bit accumulator one at a time.
+            int d = table[uchar(clean[i++])];
+            if (d < 0) continue;
+            bits = bits << 6 | uint32_t(d);
+            pendingBits += 6;
+            if (pendingBits >= 8) {
+                pendingBits -= 8;
+                *dst++ = uchar(bits >> pendingBits);
+                bits &= (1u << pendingBits) - 1;
+            }
+            if (pendingBits == 0) bits = 0;
+        }
+        out.resize(used + int(dst - start));
+    }
+
+    void decode(const QByteArray& in, QByteArray& out) { decode(in.constData(), in.size(), out); }
+
+    // Leftover bits of an unpadded final group carry no whole byte, so there is nothing to flush.
+    void finish() {
+        bits = 0;
+        pendingBits = 0;
+    }
+};
+
+#endif // BASE64CODEC_H
@@ -5,8 +5,8 @@
 #include <QListView>
 #include <QPushButton>
 #include <QLineEdit>
-#include <QStandardItemModel>
-#include <QStandardItem>
+#include <QAbstractListModel>
+#include <QVector>
 #include <QMenu>
 #include <QInputDialog>
 #include <QMessageBox>
@@ -17,162 +17,3660 @@
 #include <QSplitter>
 #include <QScrollArea>
 #include <QLabel>
+#include <QDialog>
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QPlainTextEdit>
+#include <QTimer>
+#include <QSocketNotifier>
+#include <QMap>
+#include <QCache>
+#include <QSet>
+#include <QStack>
+#include <QScrollBar>
+#include <QSharedPointer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QDataStream>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <QFile>
+#include <QFileDialog>
+#include <QListWidget>
+#include <QComboBox>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QTextBlock>
+#include <QPainter>
+#include <QMouseEvent>
+#include <QCommandLineParser>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <cstdio>
+#include <QProcess>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QCryptographicHash>
+#include <thread>
+#include <QtConcurrentRun>
+#include <QFutureWatcher>
+#include <vector>
 #include <libssh/libssh.h>
+#include "base64codec.h"
+#include "transfertuning.h"
+
+// Growable byte buffer that channel reads land in directly. Consumers take
+// whole lines out of it, so text is decoded once per line rather than once per
+// chunk, and the storage is reused across reads instead of reallocated.
+class ChunkBuffer {
+    QByteArray storage;
+    int begin = 0;
+    int end = 0;
+
+public:
+    explicit ChunkBuffer(int capacity = 0) { reserve(capacity); }
+
+    void reserve(int capacity) {
+        if (capacity > storage.size()) storage.resize(capacity);
+    }
+
+    int size() const { return end - begin; }
+    const char* data() const { return storage.constData() + begin; }
+
+    // Returns room for at least n more bytes at the tail; follow with commit().
+    char* prepare(int n) {
+        if (storage.size() - end < n) {
+            if (begin > 0) {
+                memmove(storage.data(), storage.constData() + begin, size());
+                end -= begin;
+                begin = 0;
+            }
+            if (storage.size() - end < n) storage.resize(qMax(end + n, storage.size() * 2));
+        }
+        return storage.data() + end;
+    }
+
+    void commit(int n) { end += n; }
+
+    void consume(int n) {
+        begin += n;
+        if (begin == end) begin = end = 0;
+    }
+
+    // Pops the next complete line (without its newline); with flush set, the
+    // unterminated remainder counts as a line too.
+    bool takeLine(QString& line, bool flush = false) {
+        if (begin == end) return false;
+        const char* start = storage.constData() + begin;
+        const char* newline = static_cast<const char*>(memchr(start, '\n', size()));
+        if (!newline && !flush) return false;
+        int length = newline ? int(newline - start) : size();
+        line = QString::fromUtf8(start, length);
+        consume(newline ? length + 1 : length);
+        return true;
+    }
+};
 
 class SSHSession {
 public:
-    ssh_session session = nullptr;
+    enum State { Disconnected, Connecting, Authenticating, Connected, Failed };
+
+    ssh_session session = nullptr;
+    State state = Disconnected;
+    QByteArray pendingPassword;
+
+    // Bytes requested per channel read on every read path; tuned per host.
+    int readChunkSize = 64 * 1024;
+    // Negotiated at connect time, so a change applies from the next session.
+    bool compression = false;
+
+    // Puts the session into non-blocking mode and leaves the handshake to
+    // continueConnect(), which the caller invokes whenever the socket becomes ready.
+    bool beginConnect(const QString& host, const QString& user, const QString& password) {
+        session = ssh_new();
+        if (!session) {
+            state = Failed;
+            return false;
+        }
+        ssh_options_set(session, SSH_OPTIONS_HOST, host.toStdString().c_str());
+        ssh_options_set(session, SSH_OPTIONS_USER, user.toStdString().c_str());
+        ssh_options_set(session, SSH_OPTIONS_COMPRESSION, compression ? "yes" : "no");
+        ssh_set_blocking(session, 0);
+
+        pendingPassword = password.toUtf8();
+        state = Connecting;
+        return true;
+    }
+
+    // Returns SSH_AGAIN until the connection is authenticated (SSH_OK) or has failed (SSH_ERROR).
+    int continueConnect() {
+        if (state == Connecting) {
+            int rc = ssh_connect(session);
+            if (rc == SSH_AGAIN) return SSH_AGAIN;
+            if (rc != SSH_OK) {
+                state = Failed;
+                return SSH_ERROR;
+            }
+            state = Authenticating;
+        }
+        if (state == Authenticating) {
+            int rc = ssh_userauth_password(session, nullptr, pendingPassword.constData());
+            if (rc == SSH_AUTH_AGAIN) return SSH_AGAIN;
+            pendingPassword.clear();
+            if (rc != SSH_AUTH_SUCCESS) {
+                state = Failed;
+                return SSH_ERROR;
+            }
+            state = Connected;
+        }
+        return state == Connected ? SSH_OK : SSH_ERROR;
+    }
+
+    void disconnect() {
+        if (session) {
+            ssh_disconnect(session);
+            ssh_free(session);
+            session = nullptr;
+        }
+        state = Disconnected;
+    }
+
+    ~SSHSession() { disconnect(); }
+};
+
+// Drives one session entirely from the Qt event loop: the libssh socket is
+// watched with QSocketNotifier, and connect, auth and every command channel
+// advance as small state machines whenever it becomes ready. Many commands run
+// concurrently, each on its own channel, so a slow one never holds up the rest.
+class SSHCommandExecutor : public QObject {
+    Q_OBJECT
+public:
+    typedef std::function<void(const QByteArray&)> OutputHandler;
+    typedef std::function<void(int exitStatus)> FinishedHandler;
+
+    // Background commands only start while no normal command is running, one at a time.
+    // Persistent commands (watch streams, helper channels) run like normal ones but
+    // never finish, so they do not hold background commands back.
+    enum Priority { Normal, Background, Persistent };
+
+private:
+    enum CommandState { Queued, Opening, Starting, Reading, Finishing };
+
+    struct PendingCommand {
+        QByteArray command;
+        CommandState state = Queued;
+        Priority priority = Normal;
+        ssh_channel channel = nullptr;
+        OutputHandler onOutput;
+        FinishedHandler onFinished;
+        QByteArray input;
+        int inputSent = 0;
+        bool closeInput = false;
+        bool inputClosed = false;
+    };
+
+    SSHSession* ssh;
+    ssh_event event = nullptr;
+    ssh_session polledSession = nullptr;
+    QSocketNotifier* readNotifier = nullptr;
+    QSocketNotifier* writeNotifier = nullptr;
+    QTimer* tickTimer;
+    QTimer* keepaliveTimer;
+    QMap<int, PendingCommand> commands;
+    QByteArray readBuffer;
+    int nextId = 1;
+
+public:
+    SSHCommandExecutor(SSHSession* session, QObject* parent = nullptr) : QObject(parent), ssh(session) {
+        event = ssh_event_new();
+
+        // Safety net for libssh timeouts; socket readiness does the real driving.
+        tickTimer = new QTimer(this);
+        tickTimer->setInterval(100);
+        connect(tickTimer, &QTimer::timeout, this, &SSHCommandExecutor::step);
+
+        keepaliveTimer = new QTimer(this);
+        keepaliveTimer->setInterval(30000);
+        connect(keepaliveTimer, &QTimer::timeout, this, [this]() {
+            if (isConnected()) ssh_send_ignore(ssh->session, "keepalive");
+            step();
+        });
+    }
+
+    ~SSHCommandExecutor() {
+        for (int id : commands.keys()) cancel(id);
+        if (polledSession) ssh_event_remove_session(event, polledSession);
+        ssh_event_free(event);
+    }
+
+    SSHSession* session() const { return ssh; }
+    bool isConnected() const { return ssh->state == SSHSession::Connected; }
+
+    void connectToHost(const QString& host, const QString& user, const QString& password) {
+        if (!ssh->beginConnect(host, user, password)) {
+            emit connectionFailed("Could not create SSH session");
+            return;
+        }
+        tickTimer->start();
+        step();
+    }
+
+    // Queues cmd on a fresh channel and returns its id. Commands issued before
+    // the connection is up start as soon as it is. onOutput receives stdout as
+    // it arrives, as a view that must be copied if kept; onFinished fires once
+    // with the exit status (-1 on errors).
+    int execute(const QString& cmd, OutputHandler onOutput, FinishedHandler onFinished = FinishedHandler(),
+                Priority priority = Normal) {
+        int id = nextId++;
+        PendingCommand& pending = commands[id];
+        pending.command = cmd.toUtf8();
+        pending.priority = priority;
+        pending.onOutput = onOutput;
+        pending.onFinished = onFinished;
+
+        if (ssh->state == SSHSession::Failed) {
+            QTimer::singleShot(0, this, [this, id]() { finish(id, -1); });
+            return id;
+        }
+        if (!tickTimer->isActive()) tickTimer->start();
+        if (isConnected()) QTimer::singleShot(0, this, &SSHCommandExecutor::step);
+        return id;
+    }
+
+    // Drops a command without invoking its finished handler.
+    void cancel(int id) {
+        auto it = commands.find(id);
+        if (it == commands.end()) return;
+        ssh_channel channel = it->channel;
+        commands.erase(it);
+        if (channel) {
+            if (ssh_channel_is_open(channel)) ssh_channel_close(channel);
+            ssh_channel_free(channel);
+        }
+        updateNotifiers();
+    }
+
+    // Queues data for the command's stdin; it is sent as the channel window allows.
+    bool write(int id, const QByteArray& data) {
+        auto it = commands.find(id);
+        if (it == commands.end() || it->closeInput) return false;
+        it->input.append(data);
+        if (isConnected()) QTimer::singleShot(0, this, &SSHCommandExecutor::step);
+        return true;
+    }
+
+    // Sends EOF on the command's stdin once everything queued has been written.
+    void closeInput(int id) {
+        auto it = commands.find(id);
+        if (it == commands.end()) return;
+        it->closeInput = true;
+        if (isConnected()) QTimer::singleShot(0, this, &SSHCommandExecutor::step);
+    }
+
+    bool isRunning(int id) const { return commands.contains(id); }
+    int runningCount() const { return commands.size(); }
+
+signals:
+    void connected();
+    void connectionFailed(const QString& error);
+    // Part of a command's queued stdin has gone out on its channel.
+    void inputWritten(int id, qint64 bytes);
+
+private slots:
+    void step() {
+        if (!ssh->session) return;
+
+        if (ssh->state == SSHSession::Connecting || ssh->state == SSHSession::Authenticating) {
+            int rc = ssh->continueConnect();
+            watchSocket();
+            if (rc == SSH_AGAIN) {
+                updateNotifiers();
+                return;
+            }
+            if (rc == SSH_ERROR) {
+                QString error = QString::fromUtf8(ssh_get_error(ssh->session));
+                dropNotifiers();
+                for (int id : commands.keys()) finish(id, -1);
+                emit connectionFailed(error);
+                return;
+            }
+            polledSession = ssh->session;
+            ssh_event_add_session(event, polledSession);
+            keepaliveTimer->start();
+            emit connected();
+        }
+        if (!isConnected()) return;
+
+        ssh_event_dopoll(event, 0);
+        // Handlers may start or cancel commands, so walk a snapshot of the ids.
+        for (int id : commands.keys()) {
+            if (commands.contains(id)) advance(id);
+        }
+        updateNotifiers();
+    }
+
+private:
+    void watchSocket() {
+        if (readNotifier) return;
+        socket_t fd = ssh_get_fd(ssh->session);
+        if (fd == SSH_INVALID_SOCKET) return;
+
+        readNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(readNotifier, SIGNAL(activated(int)), this, SLOT(step()));
+        writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+        writeNotifier->setEnabled(false);
+        connect(writeNotifier, SIGNAL(activated(int)), this, SLOT(step()));
+    }
+
+    void dropNotifiers() {
+        delete readNotifier;
+        delete writeNotifier;
+        readNotifier = writeNotifier = nullptr;
+        tickTimer->stop();
+        keepaliveTimer->stop();
+    }
+
+    void updateNotifiers() {
+        if (writeNotifier && ssh->session)
+            writeNotifier->setEnabled(ssh_get_poll_flags(ssh->session) & SSH_WRITE_PENDING);
+        bool busy = !commands.isEmpty() || !isConnected();
+        if (busy && ssh->session && ssh->state != SSHSession::Failed && !tickTimer->isActive()) tickTimer->start();
+        else if (!busy) tickTimer->stop();
+    }
+
+    void advance(int id) {
+        PendingCommand& cmd = commands[id];
+
+        if (cmd.state == Queued) {
+            if (cmd.priority == Background) {
+                for (auto it = commands.constBegin(); it != commands.constEnd(); ++it) {
+                    if (it.key() == id || it->priority == Persistent) continue;
+                    if (it->priority == Normal || it->state != Queued) return;
+                }
+            }
+            cmd.channel = ssh_channel_new(ssh->session);
+            if (!cmd.channel) return finish(id, -1);
+            cmd.state = Opening;
+        }
+        if (cmd.state == Opening) {
+            int rc = ssh_channel_open_session(cmd.channel);
+            if (rc == SSH_AGAIN) return;
+            if (rc != SSH_OK) return finish(id, -1);
+            cmd.state = Starting;
+        }
+        if (cmd.state == Starting) {
+            int rc = ssh_channel_request_exec(cmd.channel, cmd.command.constData());
+            if (rc == SSH_AGAIN) return;
+            if (rc != SSH_OK) return finish(id, -1);
+            cmd.state = Reading;
+        }
+        if (cmd.state == Reading) {
+            ssh_channel channel = cmd.channel;
+            if (!flushInput(id, cmd)) return finish(id, -1);
+            if (readBuffer.size() != ssh->readChunkSize) readBuffer.resize(ssh->readChunkSize);
+            char* buffer = readBuffer.data();
+            int nbytes;
+            while ((nbytes = ssh_channel_read_nonblocking(channel, buffer, readBuffer.size(), 0)) > 0) {
+                // A view onto the shared read buffer: valid only for the duration of the call.
+                OutputHandler onOutput = commands[id].onOutput;
+                if (onOutput) onOutput(QByteArray::fromRawData(buffer, nbytes));
+                if (!commands.contains(id)) return;
+            }
+            // stderr is not surfaced, but must be drained so the remote side never stalls on it.
+            while (ssh_channel_read_nonblocking(channel, buffer, readBuffer.size(), 1) > 0) {}
+
+            if (nbytes == SSH_ERROR) return finish(id, -1);
+            if (!ssh_channel_is_eof(channel)) return;
+            commands[id].state = Finishing;
+        }
+        // The exit status may trail the EOF by a packet; wait for it or for the close.
+        ssh_channel channel = commands[id].channel;
+        int status = ssh_channel_get_exit_status(channel);
+        if (status == -1 && !ssh_channel_is_closed(channel)) return;
+        finish(id, status);
+    }
+
+    bool flushInput(int id, PendingCommand& cmd) {
+        int sentBefore = cmd.inputSent;
+        while (cmd.inputSent < cmd.input.size()) {
+            quint32 window = ssh_channel_window_size(cmd.channel);
+            if (window == 0) break;
+            quint32 length = qMin<quint32>(window, quint32(cmd.input.size() - cmd.inputSent));
+            int written = ssh_channel_write(cmd.channel, cmd.input.constData() + cmd.inputSent, length);
+            if (written == SSH_ERROR) return false;
+            if (written <= 0) break;
+            cmd.inputSent += written;
+        }
+        if (cmd.inputSent > sentBefore) emit inputWritten(id, cmd.inputSent - sentBefore);
+        if (cmd.inputSent < cmd.input.size()) return true;
+        cmd.input.clear();
+        cmd.inputSent = 0;
+        if (cmd.closeInput && !cmd.inputClosed) {
+            ssh_channel_send_eof(cmd.channel);
+            cmd.inputClosed = true;
+        }
+        return true;
+    }
+
+    void finish(int id, int status) {
+        auto it = commands.find(id);
+        if (it == commands.end()) return;
+        ssh_channel channel = it->channel;
+        FinishedHandler onFinished = it->onFinished;
+        bool inputClosed = it->inputClosed;
+        commands.erase(it);
+
+        if (channel) {
+            if (ssh_channel_is_open(channel)) {
+                if (!inputClosed) ssh_channel_send_eof(channel);
+                ssh_channel_close(channel);
+            }
+            ssh_channel_free(channel);
+        }
+        if (onFinished) onFinished(status);
+    }
+};
+
+// Widget-side handle to one SSH session. The session and its executor live
+// on a thread of their own, so a slow host or a heavy transfer never stalls
+// the UI or any other session. The API mirrors SSHCommandExecutor: calls
+// are posted to the session thread as messages, and output and completions
+// come back as queued messages on the thread that owns the client. Ids are
+// allocated here, so execute() returns without waiting on the session.
+class SessionClient : public QObject {
+    Q_OBJECT
+public:
+    typedef SSHCommandExecutor::OutputHandler OutputHandler;
+    typedef SSHCommandExecutor::FinishedHandler FinishedHandler;
+
+private:
+    struct Handlers {
+        OutputHandler onOutput;
+        FinishedHandler onFinished;
+    };
+
+    QThread* thread;
+    SSHSession* ssh;
+    SSHCommandExecutor* executor;
+    QMap<int, Handlers> handlers;
+    // Client id to executor id; only touched on the session thread.
+    QMap<int, int> executorIds;
+    int nextId = 1;
+    bool connectedToHost = false;
+    TransferTuning tuned;
+    QTimer* rttTimer;
+
+public:
+    SessionClient(const QString& name, QObject* parent = nullptr) : QObject(parent) {
+        setObjectName(name);
+        thread = new QThread;
+        thread->setObjectName("session " + name);
+        ssh = new SSHSession;
+        executor = new SSHCommandExecutor(ssh);
+        executor->moveToThread(thread);
+
+        rttTimer = new QTimer(this);
+        rttTimer->setInterval(60000);
+        connect(rttTimer, &QTimer::timeout, this, &SessionClient::probeRtt);
+
+        connect(executor, &SSHCommandExecutor::connected, this, [this]() {
+            connectedToHost = true;
+            probeRtt();
+            rttTimer->start();
+            emit connected();
+        });
+        connect(executor, &SSHCommandExecutor::connectionFailed, this, &SessionClient::connectionFailed);
+        // Runs on the session thread, where the id map lives, and forwards under the client's id.
+        connect(executor, &SSHCommandExecutor::inputWritten, executor, [this](int executorId, qint64 bytes) {
+            int id = executorIds.key(executorId);
+            if (id) QMetaObject::invokeMethod(this, [this, id, bytes]() { emit inputWritten(id, bytes); }, Qt::QueuedConnection);
+        });
+        thread->start();
+    }
+
+    ~SessionClient() {
+        // The executor frees its channels on its own thread before the session goes.
+        SSHCommandExecutor* doomedExecutor = executor;
+        SSHSession* doomedSession = ssh;
+        QMetaObject::invokeMethod(executor, [doomedExecutor, doomedSession]() {
+            delete doomedExecutor;
+            delete doomedSession;
+            QThread::currentThread()->quit();
+        }, Qt::QueuedConnection);
+        thread->wait();
+        delete thread;
+    }
+
+    bool isConnected() const { return connectedToHost; }
+    bool isRunning(int id) const { return handlers.contains(id); }
+    int runningCount() const { return handlers.size(); }
+
+    void connectToHost(const QString& host, const QString& user, const QString& password) {
+        post([this, host, user, password]() { executor->connectToHost(host, user, password); });
+    }
+
+    const TransferTuning& tuning() const { return tuned; }
+
+    // Starts from parameters remembered for the host; call before connectToHost.
+    void setTuning(const TransferTuning& tuning) {
+        tuned = tuning;
+        int chunkSize = tuned.chunkSize;
+        bool compression = tuned.compression;
+        post([this, chunkSize, compression]() {
+            ssh->readChunkSize = chunkSize;
+            ssh->compression = compression;
+        });
+    }
+
+    // Feeds one finished transfer into the tuning; see TransferTuning::record.
+    void recordTransfer(qint64 bytes, qint64 elapsedMs) {
+        if (!tuned.record(bytes, elapsedMs)) return;
+        int chunkSize = tuned.chunkSize;
+        post([this, chunkSize]() { ssh->readChunkSize = chunkSize; });
+    }
+
+    int execute(const QString& cmd, OutputHandler onOutput, FinishedHandler onFinished = FinishedHandler(),
+                SSHCommandExecutor::Priority priority = SSHCommandExecutor::Normal) {
+        int id = nextId++;
+        handlers[id] = Handlers{ onOutput, onFinished };
+        bool wantsOutput = bool(onOutput);
+        post([this, id, cmd, priority, wantsOutput]() {
+            OutputHandler forward;
+            if (wantsOutput) {
+                forward = [this, id](const QByteArray& data) {
+                    // The executor hands out a view of its read buffer; the copy is what crosses threads.
+                    QByteArray copy(data.constData(), data.size());
+                    QMetaObject::invokeMethod(this, [this, id, copy]() { deliverOutput(id, copy); }, Qt::QueuedConnection);
+                };
+            }
+            executorIds[id] = executor->execute(cmd, forward, [this, id](int status) {
+                executorIds.remove(id);
+                QMetaObject::invokeMethod(this, [this, id, status]() { deliverFinished(id, status); }, Qt::QueuedConnection);
+            }, priority);
+        });
+        return id;
+    }
+
+    // Drops a command without invoking its finished handler; output already in flight is discarded.
+    void cancel(int id) {
+        if (!handlers.remove(id)) return;
+        post([this, id]() {
+            auto it = executorIds.find(id);
+            if (it == executorIds.end()) return;
+            executor->cancel(*it);
+            executorIds.erase(it);
+        });
+    }
+
+    bool write(int id, const QByteArray& data) {
+        if (!handlers.contains(id)) return false;
+        post([this, id, data]() {
+            if (executorIds.contains(id)) executor->write(executorIds[id], data);
+        });
+        return true;
+    }
+
+    void closeInput(int id) {
+        if (!handlers.contains(id)) return;
+        post([this, id]() {
+            if (executorIds.contains(id)) executor->closeInput(executorIds[id]);
+        });
+    }
+
+signals:
+    void connected();
+    void connectionFailed(const QString& error);
+    void inputWritten(int id, qint64 bytes);
+
+private:
+    // Runs alongside whatever else is active, so it tracks the loaded round trip transfers see.
+    void probeRtt() {
+        QSharedPointer<QElapsedTimer> clock(new QElapsedTimer);
+        clock->start();
+        execute(":", OutputHandler(), [this, clock](int status) {
+            if (status != 0) return;
+            double ms = clock->nsecsElapsed() / 1e6;
+            tuned.rttMs = tuned.rttMs < 0 ? ms : 0.8 * tuned.rttMs + 0.2 * ms;
+        });
+    }
+
+    void post(std::function<void()> message) {
+        QMetaObject::invokeMethod(executor, message, Qt::QueuedConnection);
+    }
+
+    void deliverOutput(int id, const QByteArray& data) {
+        auto it = handlers.constFind(id);
+        if (it != handlers.constEnd() && it->onOutput) it->onOutput(data);
+    }
+
+    void deliverFinished(int id, int status) {
+        auto it = handlers.find(id);
+        if (it == handlers.end()) return;
+        FinishedHandler onFinished = it->onFinished;
+        handlers.erase(it);
+        if (onFinished) onFinished(status);
+    }
+};
+
+// Helper shipped to the host on first use and kept running on one channel.
+// Requests are "ID OP DATALEN\n", one line per argument, then DATALEN raw
+// bytes; replies are "ID STATUS LEN\n" followed by LEN raw bytes. Requests are
+// answered in order, so callers can pipeline as many as they like.
+static const char remoteAgentScript[] = R"AGENT(#!/bin/sh
+VERSION=2
+tmp=${TMPDIR:-/tmp}/sshbrowser-agent.$$
+trap 'rm -f "$tmp" "$tmp.in"' EXIT
+printf 'SSHBAGENT %s\n' "$VERSION"
+
+reply() {
+    n=$(wc -c < "$tmp" | tr -d ' ')
+    printf '%s %s %s\n' "$1" "$2" "$n"
+    cat "$tmp"
+}
+
+range() {
+    if [ "$3" = - ]; then
+        tail -c +"$(($2 + 1))" "$1"
+    else
+        dd if="$1" bs=65536 iflag=skip_bytes,count_bytes skip="$2" count="$3" 2>/dev/null ||
+            tail -c +"$(($2 + 1))" "$1" | head -c "$3"
+    fi
+}
+
+digest() {
+    if command -v sha256sum >/dev/null 2>&1; then sha256sum; else shasum -a 256; fi | cut -d' ' -f1
+}
+
+while IFS=' ' read -r id op datalen; do
+    status=0
+    : > "$tmp"
+    case $op in
+    list)
+        IFS= read -r p
+        find "$p" -mindepth 1 -maxdepth 1 ! -name '.*' -printf '%y\t%s\t%T@\t%f\n' > "$tmp" 2>/dev/null || status=1 ;;
+    stat)
+        IFS= read -r p
+        find "$p" -maxdepth 0 -printf '%y\t%s\t%T@\t%f\n' > "$tmp" 2>/dev/null || status=1 ;;
+    read)
+        IFS= read -r p; IFS= read -r off; IFS= read -r len
+        [ -r "$p" ] && range "$p" "$off" "$len" > "$tmp" || status=1 ;;
+    write)
+        IFS= read -r p; IFS= read -r off
+        head -c "$datalen" > "$tmp.in"
+        dd if="$tmp.in" of="$p" bs=65536 oflag=seek_bytes seek="$off" conv=notrunc 2>/dev/null || status=1 ;;
+    hash)
+        IFS= read -r p; IFS= read -r off; IFS= read -r len
+        [ -r "$p" ] && range "$p" "$off" "$len" | digest > "$tmp" || status=1 ;;
+    rename)
+        IFS= read -r from; IFS= read -r to
+        mv -- "$from" "$to" > "$tmp" 2>&1 || status=1 ;;
+    quit)
+        exit 0 ;;
+    *)
+        [ "$datalen" -gt 0 ] 2>/dev/null && head -c "$datalen" > /dev/null
+        status=2 ;;
+    esac
+    reply "$id" "$status"
+done
+)AGENT";
+
+// Client side of the helper: uploads it into ~/.cache/sshbrowser once per
+// version, starts it, checks its greeting and then multiplexes requests over
+// its channel. When anything about it fails it reports unavailable() and
+// callers keep using plain shell commands.
+class RemoteAgent : public QObject {
+    Q_OBJECT
+public:
+    typedef std::function<void(int status, const QByteArray& payload)> ReplyHandler;
+    static const int version = 2;
+
+private:
+    enum State { Idle, Installing, Starting, Ready, Unavailable };
+
+    SessionClient* executor;
+    State state = Idle;
+    int setupRequest = 0;
+    int channelRequest = 0;
+    QByteArray incoming;
+    QMap<quint32, ReplyHandler> handlers;
+    quint32 nextId = 1;
+
+public:
+    RemoteAgent(SessionClient* exec, QObject* parent = nullptr) : QObject(parent), executor(exec) {}
+
+    ~RemoteAgent() {
+        executor->cancel(setupRequest);
+        executor->cancel(channelRequest);
+    }
+
+    bool isReady() const { return state == Ready; }
+
+    static QString remotePath() {
+        return QString("\"$HOME/.cache/sshbrowser/agent-%1.sh\"").arg(version);
+    }
+
+    void start() {
+        if (state != Idle) return;
+        state = Installing;
+        setupRequest = executor->execute("test -f " + remotePath(), SSHCommandExecutor::OutputHandler(), [this](int status) {
+            setupRequest = 0;
+            if (status == 0) launch();
+            else if (status == 1) install();
+            else fail();
+        });
+    }
+
+    // Sends one request; returns its id, or 0 when the agent is not running.
+    quint32 request(const QString& op, const QStringList& args, const QByteArray& data, ReplyHandler handler) {
+        if (state != Ready) return 0;
+        quint32 id = nextId++;
+        QByteArray frame = QString("%1 %2 %3\n").arg(id).arg(op).arg(data.size()).toUtf8();
+        for (const QString& arg : args) frame += arg.toUtf8() + '\n';
+        frame += data;
+        handlers[id] = handler;
+        executor->write(channelRequest, frame);
+        return id;
+    }
+
+    // Drops the handler of a request whose reply is no longer wanted.
+    void forget(quint32 id) { handlers.remove(id); }
+
+    // Shuts the helper down; pending requests fail so callers fall back to the shell.
+    void stop() {
+        if (state == Idle) return;
+        fail();
+        state = Idle;
+    }
+
+signals:
+    void ready();
+    void unavailable();
+
+private:
+    void install() {
+        QString cmd = QString("mkdir -p \"$HOME/.cache/sshbrowser\" && base64 -d > %1.tmp && mv %1.tmp %1").arg(remotePath());
+        setupRequest = executor->execute(cmd, SSHCommandExecutor::OutputHandler(), [this](int status) {
+            setupRequest = 0;
+            if (status == 0) launch();
+            else fail();
+        });
+        executor->write(setupRequest, QByteArray(remoteAgentScript).toBase64());
+        executor->closeInput(setupRequest);
+    }
+
+    void launch() {
+        state = Starting;
+        channelRequest = executor->execute("exec sh " + remotePath(),
+            [this](const QByteArray& data) { consume(data); },
+            [this](int) {
+                channelRequest = 0;
+                fail();
+            },
+            SSHCommandExecutor::Persistent);
+    }
+
+    void fail() {
+        executor->cancel(setupRequest);
+        executor->cancel(channelRequest);
+        setupRequest = 0;
+        channelRequest = 0;
+        incoming.clear();
+        state = Unavailable;
+        QMap<quint32, ReplyHandler> pending;
+        pending.swap(handlers);
+        for (const ReplyHandler& handler : pending) handler(-1, QByteArray());
+        emit unavailable();
+    }
+
+    void consume(const QByteArray& data) {
+        incoming.append(data);
+        int offset = 0;
+        for (;;) {
+            int newline = incoming.indexOf('\n', offset);
+            if (newline == -1) break;
+            QList<QByteArray> header = incoming.mid(offset, newline - offset).split(' ');
+
+            if (state == Starting) {
+                offset = newline + 1;
+                if (header.size() != 2 || header[0] != "SSHBAGENT" || header[1].toInt() != version) {
+                    // A stale or damaged install: remove it so the next session reinstalls.
+                    executor->execute("rm -f " + remotePath(), SSHCommandExecutor::OutputHandler());
+                    incoming.clear();
+                    return fail();
+                }
+                state = Ready;
+                emit ready();
+                continue;
+            }
+
+            if (header.size() != 3) {
+                incoming.clear();
+                return fail();
+            }
+            int length = header[2].toInt();
+            if (incoming.size() - (newline + 1) < length) break;
+
+            ReplyHandler handler = handlers.take(header[0].toUInt());
+            QByteArray payload = incoming.mid(newline + 1, length);
+            offset = newline + 1 + length;
+            if (handler) handler(header[1].toInt(), payload);
+            if (state != Ready) return;
+        }
+        incoming.remove(0, offset);
+    }
+};
+
+// Single-quotes s for a remote shell, so $(...), backticks and globs in file
+// names stay literal.
+static QString shellQuote(const QString& s) {
+    QString quoted = s;
+    quoted.replace("'", "'\\''");
+    return "'" + quoted + "'";
+}
+
+// Streams change notifications for one remote directory. Uses a long-lived
+// `inotifywait -m` channel when the host has it, otherwise falls back to
+// polling the directory's own mtime and reporting a coarse change.
+class DirectoryWatcher : public QObject {
+    Q_OBJECT
+    SessionClient* executor;
+    QString watchedPath;
+    QByteArray pending;
+    QTimer* pollTimer;
+    QString lastMtime;
+    int streamRequest = 0;
+    int probeRequest = 0;
+    int pollRequest = 0;
+
+public:
+    DirectoryWatcher(SessionClient* exec, QObject* parent = nullptr) : QObject(parent), executor(exec) {
+        pollTimer = new QTimer(this);
+        pollTimer->setInterval(5000);
+        connect(pollTimer, &QTimer::timeout, this, &DirectoryWatcher::pollMtime);
+    }
+
+    ~DirectoryWatcher() { stop(); }
+
+    QString path() const { return watchedPath; }
+
+    void watch(const QString& path) {
+        if (path == watchedPath && (streamRequest || probeRequest || pollTimer->isActive())) return;
+        stop();
+        watchedPath = path;
+
+        probeRequest = executor->execute("command -v inotifywait", SSHCommandExecutor::OutputHandler(), [this](int status) {
+            probeRequest = 0;
+            if (status == 0) startStream();
+            else startPolling();
+        });
+    }
+
+    void stop() {
+        executor->cancel(probeRequest);
+        executor->cancel(streamRequest);
+        executor->cancel(pollRequest);
+        probeRequest = streamRequest = pollRequest = 0;
+        pollTimer->stop();
+        pending.clear();
+        lastMtime.clear();
+    }
+
+signals:
+    void entryAdded(const QString& name, bool isDir);
+    void entryRemoved(const QString& name);
+    void entryChanged(const QString& name);
+    void directoryChanged();
+
+private:
+    void startStream() {
+        // '/' cannot occur in an event list or a file name, so it is a safe separator.
+        QString cmd = QString("inotifywait -m -q -e create,delete,moved_from,moved_to,modify,attrib --format '%e/%f' %1")
+                      .arg(shellQuote(watchedPath));
+        streamRequest = executor->execute(cmd,
+            [this](const QByteArray& data) { consume(data); },
+            [this](int) {
+                // inotifywait exits when the directory disappears or the watch limit is hit.
+                streamRequest = 0;
+                startPolling();
+            },
+            SSHCommandExecutor::Persistent);
+    }
+
+    void consume(const QByteArray& data) {
+        pending.append(data);
+        int start = 0;
+        int newline;
+        while ((newline = pending.indexOf('\n', start)) != -1) {
+            QString line = QString::fromUtf8(pending.constData() + start, newline - start);
+            start = newline + 1;
+
+            int slash = line.indexOf('/');
+            if (slash <= 0) continue;
+            QStringList events = line.left(slash).split(',');
+            QString name = line.mid(slash + 1);
+            // Listings leave dotfiles out, so editor swap and temp files must not show up as rows here.
+            if (name.isEmpty() || name.startsWith('.')) continue;
+
+            bool isDir = events.contains("ISDIR");
+            if (events.contains("CREATE") || events.contains("MOVED_TO")) emit entryAdded(name, isDir);
+            else if (events.contains("DELETE") || events.contains("MOVED_FROM")) emit entryRemoved(isDir ? name + "/" : name);
+            else emit entryChanged(isDir ? name + "/" : name);
+        }
+        pending.remove(0, start);
+    }
+
+    void startPolling() {
+        if (!pollTimer->isActive()) pollTimer->start();
+        pollMtime();
+    }
+
+    void pollMtime() {
+        if (pollRequest) return;
+        QSharedPointer<QByteArray> out(new QByteArray);
+        QString cmd = QString("stat -c %Y %1 2>/dev/null || stat -f %m %1").arg(shellQuote(watchedPath));
+        pollRequest = executor->execute(cmd,
+            [out](const QByteArray& data) { out->append(data); },
+            [this, out](int status) {
+                pollRequest = 0;
+                if (status != 0) return;
+                QString mtime = QString::fromUtf8(*out).trimmed();
+                if (!lastMtime.isEmpty() && mtime != lastMtime) emit directoryChanged();
+                lastMtime = mtime;
+            });
+    }
+};
+
+struct RemoteEntry {
+    QString name;       // as `ls -p` prints it: directories carry a trailing '/'
+    bool isDir = false;
+    qint64 size = -1;
+    qint64 mtime = -1;  // milliseconds since the epoch, -1 when unknown
+
+    bool sameMetadata(const RemoteEntry& other) const {
+        return isDir == other.isDir && size == other.size && mtime == other.mtime;
+    }
+};
+
+static bool entryLessThan(const RemoteEntry& a, const RemoteEntry& b) {
+    if (a.isDir != b.isDir) return a.isDir;
+    return a.name < b.name;
+}
+
+static bool sameListing(const QVector<RemoteEntry>& a, const QVector<RemoteEntry>& b) {
+    if (a.size() != b.size()) return false;
+    for (int i = 0; i < a.size(); ++i)
+        if (a[i].name != b[i].name || !a[i].sameMetadata(b[i])) return false;
+    return true;
+}
+
+// Lists name, type, size and mtime in one pass; hosts without GNU find fall back to plain `ls -p`.
+static QString listingCommand(const QString& path) {
+    return QString("find %1 -mindepth 1 -maxdepth 1 ! -name '.*' -printf '%y\\t%s\\t%T@\\t%f\\n' 2>/dev/null"
+                   " || ls -p %1").arg(shellQuote(path));
+}
+
+static QVector<RemoteEntry> parseListing(const QByteArray& output) {
+    QVector<RemoteEntry> entries;
+    int start = 0;
+    while (start < output.size()) {
+        int newline = output.indexOf('\n', start);
+        if (newline == -1) newline = output.size();
+        QString line = QString::fromUtf8(output.constData() + start, newline - start);
+        start = newline + 1;
+        if (line.trimmed().isEmpty()) continue;
+
+        RemoteEntry entry;
+        QStringList fields = line.split('\t');
+        if (fields.size() >= 4) {
+            entry.isDir = fields[0] == "d";
+            entry.size = fields[1].toLongLong();
+            entry.mtime = qint64(fields[2].toDouble() * 1000);
+            entry.name = fields.mid(3).join('\t') + (entry.isDir ? "/" : "");
+        } else {
+            entry.name = line;
+            entry.isDir = line.endsWith('/');
+        }
+        entries.append(entry);
+    }
+    std::sort(entries.begin(), entries.end(), entryLessThan);
+    return entries;
+}
+
+// Sorted listing of one remote directory. setEntries() diffs a fresh listing
+// against the current one and only signals the rows that actually changed, so
+// refreshing an unchanged directory keeps selection and scroll position and
+// triggers no relayout.
+class RemoteDirModel : public QAbstractListModel {
+    Q_OBJECT
+    QString dirPath;
+    QVector<RemoteEntry> entries;
+    QIcon folderIcon, fileIcon;
+
+public:
+    RemoteDirModel(QObject* parent = nullptr) : QAbstractListModel(parent) {
+        QFileIconProvider iconProvider;
+        folderIcon = iconProvider.icon(QFileIconProvider::Folder);
+        fileIcon = iconProvider.icon(QFileIconProvider::File);
+    }
+
+    QString path() const { return dirPath; }
+    const QVector<RemoteEntry>& listing() const { return entries; }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override {
+        return parent.isValid() ? 0 : entries.size();
+    }
+
+    QVariant data(const QModelIndex& index, int role) const override {
+        if (!index.isValid() || index.row() >= entries.size()) return QVariant();
+        const RemoteEntry& entry = entries[index.row()];
+        switch (role) {
+        case Qt::DisplayRole: return entry.name;
+        case Qt::DecorationRole: return entry.isDir ? folderIcon : fileIcon;
+        case Qt::UserRole: return dirPath + "/" + entry.name;
+        case Qt::UserRole + 1: return entry.size;
+        default: return QVariant();
+        }
+    }
+
+    // Replaces the listing. Switching directories resets the model; refreshing
+    // the same directory applies a minimal diff. fresh must be sorted by entryLessThan.
+    void setEntries(const QString& path, const QVector<RemoteEntry>& fresh) {
+        if (path != dirPath) {
+            beginResetModel();
+            dirPath = path;
+            entries = fresh;
+            endResetModel();
+            return;
+        }
+
+        // Pass 1: drop rows that are gone, in contiguous runs from the back.
+        int i = entries.size() - 1, j = fresh.size() - 1;
+        while (i >= 0) {
+            while (j >= 0 && entryLessThan(entries[i], fresh[j])) --j;
+            if (j >= 0 && !entryLessThan(fresh[j], entries[i])) {
+                --i;
+                continue;
+            }
+            int last = i;
+            while (i > 0) {
+                while (j >= 0 && entryLessThan(entries[i - 1], fresh[j])) --j;
+                if (j >= 0 && !entryLessThan(fresh[j], entries[i - 1])) break;
+                --i;
+            }
+            beginRemoveRows(QModelIndex(), i, last);
+            entries.remove(i, last - i + 1);
+            endRemoveRows();
+            --i;
+        }
+
+        // Pass 2: entries is now a sorted subset of fresh; insert the missing runs.
+        int row = 0;
+        j = 0;
+        while (j < fresh.size()) {
+            if (row < entries.size() && !entryLessThan(fresh[j], entries[row])) {
+                ++row;
+                ++j;
+                continue;
+            }
+            int end = j;
+            while (end < fresh.size() && (row >= entries.size() || entryLessThan(fresh[end], entries[row]))) ++end;
+            beginInsertRows(QModelIndex(), row, row + end - j - 1);
+            entries.insert(row, end - j, RemoteEntry());
+            for (int k = j; k < end; ++k) entries[row + k - j] = fresh[k];
+            endInsertRows();
+            row += end - j;
+            j = end;
+        }
+
+        // Pass 3: rows now line up one to one; report metadata changes in runs.
+        int first = -1;
+        for (int r = 0; r <= entries.size(); ++r) {
+            bool changed = r < entries.size() && !entries[r].sameMetadata(fresh[r]);
+            if (changed) {
+                entries[r] = fresh[r];
+                if (first == -1) first = r;
+            } else if (first != -1) {
+                emit dataChanged(index(first), index(r - 1));
+                first = -1;
+            }
+        }
+    }
+
+    int rowForName(const QString& name) const {
+        for (bool isDir : { name.endsWith('/'), !name.endsWith('/') }) {
+            RemoteEntry key;
+            key.name = name;
+            key.isDir = isDir;
+            auto it = std::lower_bound(entries.begin(), entries.end(), key, entryLessThan);
+            if (it != entries.end() && it->name == name) return int(it - entries.begin());
+        }
+        return -1;
+    }
+
+    void insertEntry(const RemoteEntry& entry) {
+        if (rowForName(entry.name) != -1) return;
+        int row = int(std::lower_bound(entries.begin(), entries.end(), entry, entryLessThan) - entries.begin());
+        beginInsertRows(QModelIndex(), row, row);
+        entries.insert(row, entry);
+        endInsertRows();
+    }
+
+    void removeEntry(const QString& name) {
+        int row = rowForName(name);
+        if (row == -1) return;
+        beginRemoveRows(QModelIndex(), row, row);
+        entries.remove(row);
+        endRemoveRows();
+    }
+
+    // Stores fresh metadata for an existing row and signals only that row.
+    void updateEntry(const RemoteEntry& entry) {
+        int row = rowForName(entry.name);
+        if (row == -1 || entries[row].sameMetadata(entry)) return;
+        entries[row] = entry;
+        emit dataChanged(index(row), index(row));
+    }
+};
+
+struct ManifestEntry {
+    qint64 size = -1;
+    qint64 mtime = -1;  // milliseconds since the epoch
+    QByteArray hash;    // hex SHA-256, empty when not computed
+};
+
+// Files of one tree keyed by path relative to its root.
+typedef QMap<QString, ManifestEntry> Manifest;
+
+// A host the user has connected to before.
+struct SavedConnection {
+    QString host;
+    QString user;
+    QString password;
+
+    QString key() const { return user + "@" + host; }
+};
+
+// Compact on-disk snapshots of recently seen listings, keyed by host and path,
+// so the window can paint the last known state before the connection is up.
+// Lives in the same settings.db as the saved connections.
+class ListingSnapshotStore {
+    QSqlDatabase db;
+    static const int maxPathsPerHost = 200;
+
+public:
+    bool open(const QString& fileName = "settings.db") {
+        db = QSqlDatabase::addDatabase("QSQLITE", "snapshots");
+        db.setDatabaseName(fileName);
+        if (!db.open()) return false;
+        QSqlQuery q(db);
+        q.exec("CREATE TABLE IF NOT EXISTS listings (host TEXT, path TEXT, fetched INTEGER, data BLOB, PRIMARY KEY (host, path))");
+        q.exec("CREATE TABLE IF NOT EXISTS metrics (name TEXT, value REAL, recorded INTEGER)");
+        q.exec("CREATE TABLE IF NOT EXISTS sync_manifests (host TEXT, pair TEXT, data BLOB, PRIMARY KEY (host, pair))");
+        q.exec("CREATE TABLE IF NOT EXISTS connections (host TEXT, user TEXT, pass TEXT, PRIMARY KEY (host, user))");
+        q.exec("CREATE TABLE IF NOT EXISTS transfer_tuning (host TEXT PRIMARY KEY, chunk INTEGER, inflight INTEGER,"
+               " compression INTEGER, rtt REAL, throughput REAL, updated INTEGER)");
+        q.exec("CREATE TABLE IF NOT EXISTS preferences (name TEXT PRIMARY KEY, value TEXT)");
+        return true;
+    }
+
+    bool load(const QString& host, const QString& path, QVector<RemoteEntry>& entries) {
+        if (!db.isOpen()) return false;
+        QSqlQuery q(db);
+        q.prepare("SELECT data FROM listings WHERE host = ? AND path = ?");
+        q.addBindValue(host);
+        q.addBindValue(path);
+        if (!q.exec() || !q.next()) return false;
+
+        QByteArray raw = qUncompress(q.value(0).toByteArray());
+        QDataStream in(raw);
+        quint8 version;
+        quint32 count;
+        in >> version >> count;
+        if (version != 1 || in.status() != QDataStream::Ok) return false;
+
+        entries.clear();
+        entries.reserve(count);
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            RemoteEntry entry;
+            in >> entry.name >> entry.isDir >> entry.size >> entry.mtime;
+            entries.append(entry);
+        }
+        return in.status() == QDataStream::Ok;
+    }
+
+    void save(const QString& host, const QString& path, const QVector<RemoteEntry>& entries) {
+        if (!db.isOpen()) return;
+        QByteArray raw;
+        QDataStream out(&raw, QIODevice::WriteOnly);
+        out << quint8(1) << quint32(entries.size());
+        for (const RemoteEntry& entry : entries)
+            out << entry.name << entry.isDir << entry.size << entry.mtime;
+
+        QSqlQuery q(db);
+        q.prepare("INSERT OR REPLACE INTO listings (host, path, fetched, data) VALUES (?, ?, ?, ?)");
+        q.addBindValue(host);
+        q.addBindValue(path);
+        q.addBindValue(QDateTime::currentMSecsSinceEpoch());
+        q.addBindValue(qCompress(raw));
+        q.exec();
+
+        q.prepare("DELETE FROM listings WHERE host = ? AND path NOT IN "
+                  "(SELECT path FROM listings WHERE host = ? ORDER BY fetched DESC LIMIT ?)");
+        q.addBindValue(host);
+        q.addBindValue(host);
+        q.addBindValue(maxPathsPerHost);
+        q.exec();
+    }
+
+    // The manifest a sync pair agreed on after its last run.
+    bool loadManifest(const QString& host, const QString& pair, Manifest& manifest) {
+        if (!db.isOpen()) return false;
+        QSqlQuery q(db);
+        q.prepare("SELECT data FROM sync_manifests WHERE host = ? AND pair = ?");
+        q.addBindValue(host);
+        q.addBindValue(pair);
+        if (!q.exec() || !q.next()) return false;
+
+        QByteArray raw = qUncompress(q.value(0).toByteArray());
+        QDataStream in(raw);
+        quint8 version;
+        quint32 count;
+        in >> version >> count;
+        if (version != 1 || in.status() != QDataStream::Ok) return false;
+
+        manifest.clear();
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            QString path;
+            ManifestEntry entry;
+            in >> path >> entry.size >> entry.mtime >> entry.hash;
+            manifest.insert(path, entry);
+        }
+        return in.status() == QDataStream::Ok;
+    }
+
+    void saveManifest(const QString& host, const QString& pair, const Manifest& manifest) {
+        if (!db.isOpen()) return;
+        QByteArray raw;
+        QDataStream out(&raw, QIODevice::WriteOnly);
+        out << quint8(1) << quint32(manifest.size());
+        for (auto it = manifest.constBegin(); it != manifest.constEnd(); ++it)
+            out << it.key() << it->size << it->mtime << it->hash;
+
+        QSqlQuery q(db);
+        q.prepare("INSERT OR REPLACE INTO sync_manifests (host, pair, data) VALUES (?, ?, ?)");
+        q.addBindValue(host);
+        q.addBindValue(pair);
+        q.addBindValue(qCompress(raw));
+        q.exec();
+    }
+
+    QList<SavedConnection> savedConnections() {
+        QList<SavedConnection> connections;
+        if (!db.isOpen()) return connections;
+        QSqlQuery q(db);
+        q.exec("SELECT host, user, pass FROM connections ORDER BY host, user");
+        while (q.next()) {
+            SavedConnection connection;
+            connection.host = q.value(0).toString();
+            connection.user = q.value(1).toString();
+            connection.password = q.value(2).toString();
+            connections.append(connection);
+        }
+        return connections;
+    }
+
+    void saveConnection(const QString& host, const QString& user, const QString& password) {
+        if (!db.isOpen()) return;
+        QSqlQuery q(db);
+        q.prepare("INSERT OR REPLACE INTO connections (host, user, pass) VALUES (?, ?, ?)");
+        q.addBindValue(host);
+        q.addBindValue(user);
+        q.addBindValue(password);
+        q.exec();
+    }
+
+    bool loadTuning(const QString& host, TransferTuning& tuning) {
+        if (!db.isOpen()) return false;
+        QSqlQuery q(db);
+        q.prepare("SELECT chunk, inflight, compression, rtt, throughput FROM transfer_tuning WHERE host = ?");
+        q.addBindValue(host);
+        if (!q.exec() || !q.next()) return false;
+        tuning.chunkSize = q.value(0).toInt();
+        tuning.inFlight = q.value(1).toInt();
+        tuning.compression = q.value(2).toBool();
+        tuning.rttMs = q.value(3).toDouble();
+        tuning.bytesPerSecond = q.value(4).toDouble();
+        return true;
+    }
+
+    void saveTuning(const QString& host, const TransferTuning& tuning) {
+        if (!db.isOpen()) return;
+        QSqlQuery q(db);
+        q.prepare("INSERT OR REPLACE INTO transfer_tuning (host, chunk, inflight, compression, rtt, throughput, updated)"
+                  " VALUES (?, ?, ?, ?, ?, ?, ?)");
+        q.addBindValue(host);
+        q.addBindValue(tuning.chunkSize);
+        q.addBindValue(tuning.inFlight);
+        q.addBindValue(tuning.compression);
+        q.addBindValue(tuning.rttMs);
+        q.addBindValue(tuning.bytesPerSecond);
+        q.addBindValue(QDateTime::currentMSecsSinceEpoch());
+        q.exec();
+    }
+
+    QVariant preference(const QString& name, const QVariant& fallback = QVariant()) {
+        if (!db.isOpen()) return fallback;
+        QSqlQuery q(db);
+        q.prepare("SELECT value FROM preferences WHERE name = ?");
+        q.addBindValue(name);
+        if (!q.exec() || !q.next()) return fallback;
+        return q.value(0);
+    }
+
+    void setPreference(const QString& name, const QVariant& value) {
+        if (!db.isOpen()) return;
+        QSqlQuery q(db);
+        q.prepare("INSERT OR REPLACE INTO preferences (name, value) VALUES (?, ?)");
+        q.addBindValue(name);
+        q.addBindValue(value.toString());
+        q.exec();
+    }
+
+    void recordMetric(const QString& name, double value) {
+        if (!db.isOpen()) return;
+        QSqlQuery q(db);
+        q.prepare("INSERT INTO metrics (name, value, recorded) VALUES (?, ?, ?)");
+        q.addBindValue(name);
+        q.addBindValue(value);
+        q.addBindValue(QDateTime::currentMSecsSinceEpoch());
+        q.exec();
+    }
+};
+
+static QElapsedTimer startupTimer;
+
+// Measures how late a 16 ms timer on the UI thread fires and records the
+// 99th percentile and worst lateness every few seconds, so the effect of
+// concurrent sessions on frame latency shows up in the metrics table. It is a
+// diagnostic: only enabled with SSHBROWSER_FRAME_PROBE set.
+class FrameLatencyProbe : public QObject {
+    Q_OBJECT
+    static const int frameMs = 16;
+    static const int reportMs = 5000;
+
+    ListingSnapshotStore* store;
+    QElapsedTimer frameClock;
+    QElapsedTimer reportClock;
+    QVector<int> lateness;
+
+public:
+    FrameLatencyProbe(ListingSnapshotStore* snapshots, QObject* parent = nullptr) : QObject(parent), store(snapshots) {
+        QTimer* timer = new QTimer(this);
+        timer->setTimerType(Qt::PreciseTimer);
+        timer->setInterval(frameMs);
+        connect(timer, &QTimer::timeout, this, &FrameLatencyProbe::tick);
+        frameClock.start();
+        reportClock.start();
+        timer->start();
+    }
+
+private:
+    void tick() {
+        lateness.append(int(qMax<qint64>(0, frameClock.restart() - frameMs)));
+        if (reportClock.elapsed() < reportMs) return;
+        std::sort(lateness.begin(), lateness.end());
+        store->recordMetric("ui.frame_late_p99_ms", lateness[lateness.size() * 99 / 100]);
+        store->recordMetric("ui.frame_late_max_ms", lateness.last());
+        lateness.clear();
+        reportClock.restart();
+    }
+};
+
+// Read-only console that takes raw command output as it streams in. Appends
+// are coalesced and flushed at most once per frame, only complete lines are
+// decoded, and the block limit turns the document into a ring buffer.
+class ConsoleView : public QPlainTextEdit {
+    Q_OBJECT
+    QByteArray pending;
+    QTimer* flushTimer;
+
+public:
+    ConsoleView(QWidget* parent = nullptr) : QPlainTextEdit(parent) {
+        setReadOnly(true);
+        setMaximumBlockCount(10000);
+        flushTimer = new QTimer(this);
+        flushTimer->setSingleShot(true);
+        flushTimer->setInterval(16);
+        connect(flushTimer, &QTimer::timeout, this, [this]() { flush(false); });
+    }
+
+    void appendOutput(const QByteArray& data) {
+        pending.append(data);
+        if (!flushTimer->isActive()) flushTimer->start();
+    }
+
+    void appendLine(const QString& line) {
+        flush(true);
+        appendPlainText(line);
+    }
+
+    // Writes everything buffered; a trailing partial line is held back unless force is set.
+    void flush(bool force) {
+        int end = force ? pending.size() : pending.lastIndexOf('\n') + 1;
+        if (end <= 0) return;
+        int length = end;
+        if (length > 0 && pending[length - 1] == '\n') --length;
+
+        // Anything beyond the retained block count would be trimmed straight away.
+        int start = 0;
+        int lines = 0;
+        for (int i = length - 1; i >= 0; --i) {
+            if (pending[i] == '\n' && ++lines >= maximumBlockCount()) {
+                start = i + 1;
+                break;
+            }
+        }
+        appendPlainText(QString::fromUtf8(pending.constData() + start, length - start));
+        pending.remove(0, end);
+    }
+};
+
+struct CachedListing {
+    QVector<RemoteEntry> entries;
+    qint64 fetched = 0;
+};
+
+// Recently fetched listings kept in memory, least recently used evicted first.
+typedef QCache<QString, CachedListing> ListingCache;
+
+// Speculatively lists directories the user is likely to enter next, at
+// background priority so it never competes with interactive commands. Each
+// round is bounded by a request count, an output byte budget and a deadline,
+// and is abandoned as soon as a new round starts.
+class ListingPrefetcher : public QObject {
+    Q_OBJECT
+    SessionClient* executor;
+    ListingCache* cache;
+    QStringList queue;
+    QList<int> inFlight;
+    QElapsedTimer roundTimer;
+    QTimer* deadline;
+    qint64 bytesUsed = 0;
+    int issued = 0;
+
+    static const int maxRequestsPerRound = 24;
+    static const int maxParallel = 2;
+    static const qint64 byteBudget = 2 * 1024 * 1024;
+    static const qint64 timeBudgetMs = 5000;
+    static const qint64 freshForMs = 30000;
+
+public:
+    ListingPrefetcher(SessionClient* exec, ListingCache* listingCache, QObject* parent = nullptr)
+        : QObject(parent), executor(exec), cache(listingCache), deadline(new QTimer(this)) {
+        // A stalled listing never comes back to pump(), so the deadline cancels the round itself.
+        deadline->setSingleShot(true);
+        deadline->setInterval(timeBudgetMs);
+        connect(deadline, &QTimer::timeout, this, &ListingPrefetcher::cancel);
+    }
+
+    // Starts a new round over candidates, most likely first.
+    void prefetch(const QStringList& candidates) {
+        cancel();
+        roundTimer.start();
+        deadline->start();
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (const QString& path : candidates) {
+            CachedListing* cached = cache->object(path);
+            if (cached && now - cached->fetched < freshForMs) continue;
+            if (!queue.contains(path)) queue.append(path);
+        }
+        pump();
+    }
+
+    void cancel() {
+        deadline->stop();
+        for (int id : inFlight) executor->cancel(id);
+        inFlight.clear();
+        queue.clear();
+        bytesUsed = 0;
+        issued = 0;
+    }
+
+private:
+    bool overBudget() const {
+        return issued >= maxRequestsPerRound || bytesUsed >= byteBudget || roundTimer.elapsed() >= timeBudgetMs;
+    }
+
+    void pump() {
+        while (!queue.isEmpty() && inFlight.size() < maxParallel) {
+            if (overBudget()) {
+                cancel();
+                return;
+            }
+            QString path = queue.takeFirst();
+            QSharedPointer<QByteArray> listing(new QByteArray);
+            QSharedPointer<int> id(new int(0));
+            *id = executor->execute(listingCommand(path),
+                [this, listing, id](const QByteArray& data) {
+                    listing->append(data);
+                    bytesUsed += data.size();
+                    if (bytesUsed >= byteBudget) {
+                        executor->cancel(*id);
+                        inFlight.removeAll(*id);
+                    }
+                },
+                [this, path, listing, id](int status) {
+                    inFlight.removeAll(*id);
+                    if (status == 0) {
+                        CachedListing* cached = new CachedListing;
+                        cached->entries = parseListing(*listing);
+                        cached->fetched = QDateTime::currentMSecsSinceEpoch();
+                        cache->insert(path, cached);
+                    }
+                    pump();
+                },
+                SSHCommandExecutor::Background);
+            inFlight.append(*id);
+            ++issued;
+        }
+    }
+};
+
+static QString joinPath(const QString& dir, const QString& name) {
+    QString child = name.endsWith('/') ? name.left(name.size() - 1) : name;
+    return dir.endsWith('/') ? dir + child : dir + "/" + child;
+}
+
+// Hashes a local directory tree into result, walking directories on several
+// threads. Hashes of files whose size and mtime match previous are reused
+// instead of recomputed. Returns false when some directory could not be read,
+// in which case result is incomplete.
+static bool scanLocalTree(const QString& root, const Manifest& previous, bool withHashes, Manifest& result) {
+    QMutex mutex;
+    QWaitCondition wake;
+    QStringList pendingDirs(QString(""));
+    int busy = 0;
+    bool complete = true;
+
+    auto worker = [&]() {
+        for (;;) {
+            QString dir;
+            {
+                QMutexLocker lock(&mutex);
+                while (pendingDirs.isEmpty() && busy > 0) wake.wait(&mutex);
+                if (pendingDirs.isEmpty()) return;
+                dir = pendingDirs.takeLast();
+                ++busy;
+            }
+
+            QStringList subdirs;
+            Manifest found;
+            QDir d(dir.isEmpty() ? root : root + "/" + dir);
+            bool readable = d.isReadable();
+            for (const QFileInfo& info : d.entryInfoList(QDir::Files | QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot | QDir::NoSymLinks)) {
+                QString rel = dir.isEmpty() ? info.fileName() : dir + "/" + info.fileName();
+                if (info.isDir()) {
+                    subdirs << rel;
+                    continue;
+                }
+                ManifestEntry entry;
+                entry.size = info.size();
+                entry.mtime = info.lastModified().toMSecsSinceEpoch();
+                if (withHashes) {
+                    auto prev = previous.constFind(rel);
+                    if (prev != previous.constEnd() && prev->size == entry.size && prev->mtime == entry.mtime && !prev->hash.isEmpty()) {
+                        entry.hash = prev->hash;
+                    } else {
+                        QFile file(info.filePath());
+                        QCryptographicHash hash(QCryptographicHash::Sha256);
+                        if (file.open(QIODevice::ReadOnly) && hash.addData(&file)) entry.hash = hash.result().toHex();
+                    }
+                }
+                found.insert(rel, entry);
+            }
+
+            QMutexLocker lock(&mutex);
+            if (!readable) complete = false;
+            pendingDirs += subdirs;
+            for (auto it = found.constBegin(); it != found.constEnd(); ++it) result.insert(it.key(), it.value());
+            --busy;
+            wake.wakeAll();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < qMax(2, QThread::idealThreadCount()); ++i) threads.emplace_back(worker);
+    for (std::thread& thread : threads) thread.join();
+    return complete;
+}
+
+static bool sameContent(const ManifestEntry& a, const ManifestEntry& b) {
+    if (a.size != b.size) return false;
+    if (!a.hash.isEmpty() && !b.hash.isEmpty()) return a.hash == b.hash;
+    // Some filesystems keep only 2 s mtime resolution.
+    return qAbs(a.mtime - b.mtime) < 2000;
+}
+
+struct SyncAction {
+    enum Kind { Upload, Download, DeleteLocal, DeleteRemote, Conflict };
+    Kind kind;
+    QString path;
+    qint64 size;
+};
+
+// Three-way plan against the manifest recorded after the last sync. A side
+// counts as changed when it no longer matches that base; without a base the
+// newer file wins and nothing is ever deleted.
+static QVector<SyncAction> planSync(const Manifest& local, const Manifest& remote, const Manifest& base) {
+    QVector<SyncAction> plan;
+    QStringList paths = local.keys() + remote.keys();
+    std::sort(paths.begin(), paths.end());
+    paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+    for (const QString& path : paths) {
+        auto l = local.constFind(path), r = remote.constFind(path), b = base.constFind(path);
+        bool hasL = l != local.constEnd(), hasR = r != remote.constEnd(), hasB = b != base.constEnd();
+        bool localChanged = hasL && (!hasB || !sameContent(*l, *b));
+        bool remoteChanged = hasR && (!hasB || !sameContent(*r, *b));
+
+        if (hasL && hasR) {
+            if (sameContent(*l, *r)) continue;
+            if (hasB && localChanged && remoteChanged) plan.append({ SyncAction::Conflict, path, l->size });
+            else if (hasB ? localChanged : l->mtime > r->mtime) plan.append({ SyncAction::Upload, path, l->size });
+            else plan.append({ SyncAction::Download, path, r->size });
+        } else if (hasL) {
+            if (!hasB) plan.append({ SyncAction::Upload, path, l->size });
+            else if (localChanged) plan.append({ SyncAction::Conflict, path, l->size });
+            else plan.append({ SyncAction::DeleteLocal, path, l->size });
+        } else {
+            if (!hasB) plan.append({ SyncAction::Download, path, r->size });
+            else if (remoteChanged) plan.append({ SyncAction::Conflict, path, r->size });
+            else plan.append({ SyncAction::DeleteRemote, path, r->size });
+        }
+    }
+    return plan;
+}
+
+// Bidirectional sync of a local tree with a remote one. Both manifests are
+// built concurrently (one streaming find on the host, a threaded walk
+// locally), diffed against the previous sync, and the resulting plan is
+// executed as batched tar streams over several channels at once. Large
+// files present on both sides go block by block through the helper agent
+// when it is running, so only changed blocks cross the wire.
+class SyncEngine : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        QString localRoot;
+        QString remoteRoot;
+        bool withHashes = false;
+        bool incremental = true;
+        bool dryRun = false;
+    };
+
+private:
+    static const int maxBatchFiles = 256;
+    static const qint64 maxBatchBytes = 64 * 1024 * 1024;
+    static const qint64 deltaThreshold = 4 * 1024 * 1024;
+    static const qint64 blockSize = 1024 * 1024;
+
+    SessionClient* executor;
+    RemoteAgent* agent;
+    ListingSnapshotStore* store;
+    QString hostKey;
+    Options options;
+    Manifest local, remote, base;
+    bool localReady = false, remoteReady = false;
+    bool aborted = false;
+    int manifestRequest = 0;
+
+    // Whether the local walk read every directory, and what it found.
+    typedef QPair<bool, Manifest> LocalScan;
+    QFutureWatcher<LocalScan>* localScan = nullptr;
+    QVector<SyncAction> plan;
+    QList<QVector<SyncAction>> batches;
+    QList<SyncAction> deltas;
+    int failures = 0;
+    int transferred = 0;
+    QElapsedTimer stepClock;
+
+    // Tar batches run side by side, up to the host's tuned window. Their
+    // throughput is sampled across all of them, since they share the link.
+    int batchesRunning = 0;
+    qint64 sampleBytes = 0;
+    QElapsedTimer sampleClock;
+
+    // State of the delta transfer in progress; only one runs at a time.
+    SyncAction blockAction;
+    QSharedPointer<QFile> blockFile;
+    QList<qint64> blockQueue;
+    int blocksInFlight = 0;
+    qint64 blockBytes = 0;
+    bool blocksOk = true;
+    bool blockUpload = false;
+
+public:
+    SyncEngine(SessionClient* exec, RemoteAgent* remoteAgent, ListingSnapshotStore* snapshots,
+               const QString& host, QObject* parent = nullptr)
+        : QObject(parent), executor(exec), agent(remoteAgent), store(snapshots), hostKey(host) {}
+
+    const QVector<SyncAction>& currentPlan() const { return plan; }
+
+    static QString describe(const SyncAction& action) {
+        static const char* const names[] = { "upload", "download", "delete local", "delete remote", "CONFLICT" };
+        return QString("%1  %2  (%3 bytes)").arg(names[action.kind], -13).arg(action.path).arg(action.size);
+    }
+
+    void start(const Options& opts) {
+        options = opts;
+        local.clear();
+        remote.clear();
+        localReady = remoteReady = false;
+        aborted = false;
+        localScan = nullptr;
+        plan.clear();
+        base.clear();
+        store->loadManifest(hostKey, manifestKey(), base);
+        emit progress("Building manifests...");
+
+        // A missing tree would plan every file it used to hold as deleted, so
+        // it only counts as empty on a first sync, when nothing is deleted.
+        QString root = options.localRoot;
+        if (!QFileInfo(root).isDir()) {
+            if (!base.isEmpty()) return abort("Local folder " + root + " is missing");
+            localReady = true;
+        } else {
+            // Hash reuse is what makes incremental runs cheap; a full run rehashes everything.
+            Manifest reuse = options.incremental ? base : Manifest();
+            bool withHashes = options.withHashes;
+            // The walk captures only copies; its result comes back through a watcher
+            // owned by the engine, so nothing reaches a deleted engine.
+            localScan = new QFutureWatcher<LocalScan>(this);
+            QFutureWatcher<LocalScan>* scan = localScan;
+            connect(scan, &QFutureWatcher<LocalScan>::finished, this, [this, scan]() {
+                LocalScan result = scan->result();
+                scan->deleteLater();
+                if (scan != localScan || aborted) return;
+                localScan = nullptr;
+                if (!result.first) return abort("Some local folders could not be read");
+                local = result.second;
+                localReady = true;
+                manifestsMaybeReady();
+            });
+            scan->setFuture(QtConcurrent::run([root, reuse, withHashes]() -> LocalScan {
+                LocalScan result;
+                result.first = scanLocalTree(root, reuse, withHashes, result.second);
+                return result;
+            }));
+        }
+
+        QSharedPointer<ChunkBuffer> buffer(new ChunkBuffer);
+        QString cmd = QString("test -d %1 || exit 3; cd %1 && find . -type f -printf '%P\\t%s\\t%T@\\n'")
+                      .arg(shellQuote(options.remoteRoot));
+        manifestRequest = executor->execute(cmd,
+            [this, buffer](const QByteArray& data) {
+                memcpy(buffer->prepare(data.size()), data.constData(), data.size());
+                buffer->commit(data.size());
+                QString line;
+                while (buffer->takeLine(line)) addRemoteLine(line);
+            },
+            [this, buffer](int status) {
+                manifestRequest = 0;
+                if (status == 3 && base.isEmpty()) {
+                    remote.clear();
+                    remoteReady = true;
+                    return manifestsMaybeReady();
+                }
+                // find exits non-zero when it could not read part of the tree; -1 is a lost channel.
+                if (status == 3) return abort("Remote folder " + options.remoteRoot + " is missing");
+                if (status != 0) return abort("Could not list the remote folder completely");
+                QString line;
+                while (buffer->takeLine(line, true)) addRemoteLine(line);
+                hashRemote();
+            });
+    }
+
+    // Runs the current plan; conflicts are reported and left alone.
+    void execute() {
+        batches.clear();
+        deltas.clear();
+        failures = transferred = 0;
+
+        QVector<SyncAction> deleteRemote, uploads, downloads;
+        for (const SyncAction& action : plan) {
+            switch (action.kind) {
+            case SyncAction::DeleteLocal:
+                if (QFile::remove(options.localRoot + "/" + action.path)) local.remove(action.path);
+                else ++failures;
+                break;
+            case SyncAction::DeleteRemote:
+                deleteRemote.append(action);
+                break;
+            case SyncAction::Upload:
+            case SyncAction::Download:
+                if (agent->isReady() && action.size >= deltaThreshold && local.contains(action.path) && remote.contains(action.path))
+                    deltas.append(action);
+                else if (action.kind == SyncAction::Upload) uploads.append(action);
+                else downloads.append(action);
+                break;
+            case SyncAction::Conflict:
+                break;
+            }
+        }
+        if (!deleteRemote.isEmpty()) batches.append(deleteRemote);
+        splitIntoBatches(uploads);
+        splitIntoBatches(downloads);
+        batchesRunning = 0;
+        sampleBytes = 0;
+        sampleClock.start();
+        nextStep();
+    }
+
+signals:
+    void progress(const QString& message);
+    void planReady();
+    void finished(bool ok, const QString& summary);
+
+private:
+    QString manifestKey() const { return options.localRoot + "|" + options.remoteRoot; }
+
+    void addRemoteLine(const QString& line) {
+        QStringList fields = line.split('\t');
+        if (fields.size() < 3) return;
+        ManifestEntry entry;
+        entry.size = fields[1].toLongLong();
+        entry.mtime = qint64(fields[2].toDouble() * 1000);
+        remote.insert(fields[0], entry);
+    }
+
+    void hashRemote() {
+        QStringList needed;
+        if (options.withHashes) {
+            for (auto it = remote.begin(); it != remote.end(); ++it) {
+                auto prev = base.constFind(it.key());
+                if (options.incremental && prev != base.constEnd() && prev->size == it->size && prev->mtime == it->mtime && !prev->hash.isEmpty())
+                    it->hash = prev->hash;
+                else
+                    needed << it.key();
+            }
+        }
+        if (needed.isEmpty()) {
+            remoteReady = true;
+            return manifestsMaybeReady();
+        }
+
+        emit progress(QString("Hashing %1 remote files...").arg(needed.size()));
+        QSharedPointer<ChunkBuffer> buffer(new ChunkBuffer);
+        auto addHashLine = [this](const QString& line) {
+            // sha256sum prints "<64 hex digits>  <path>".
+            if (line.size() > 66) {
+                auto it = remote.find(line.mid(66));
+                if (it != remote.end()) it->hash = line.left(64).toLatin1();
+            }
+        };
+        QString cmd = QString("cd %1 && tr '\\n' '\\0' | xargs -0 sha256sum --").arg(shellQuote(options.remoteRoot));
+        manifestRequest = executor->execute(cmd,
+            [buffer, addHashLine](const QByteArray& data) {
+                memcpy(buffer->prepare(data.size()), data.constData(), data.size());
+                buffer->commit(data.size());
+                QString line;
+                while (buffer->takeLine(line)) addHashLine(line);
+            },
+            [this, buffer, addHashLine](int status) {
+                manifestRequest = 0;
+                if (status != 0) return abort("Could not hash every remote file");
+                QString line;
+                while (buffer->takeLine(line, true)) addHashLine(line);
+                remoteReady = true;
+                manifestsMaybeReady();
+            });
+        executor->write(manifestRequest, needed.join('\n').toUtf8() + '\n');
+        executor->closeInput(manifestRequest);
+    }
+
+    // Ends the run without a plan or a base update; partial manifests would read as deletions.
+    void abort(const QString& reason) {
+        if (aborted) return;
+        aborted = true;
+        executor->cancel(manifestRequest);
+        manifestRequest = 0;
+        plan.clear();
+        emit finished(false, reason);
+    }
+
+    void manifestsMaybeReady() {
+        if (aborted || !localReady || !remoteReady) return;
+        plan = planSync(local, remote, base);
+        emit planReady();
+        if (options.dryRun) emit finished(true, QString("Dry run: %1 actions planned").arg(plan.size()));
+    }
+
+    void splitIntoBatches(const QVector<SyncAction>& actions) {
+        QVector<SyncAction> batch;
+        qint64 bytes = 0;
+        for (const SyncAction& action : actions) {
+            if (!batch.isEmpty() && (batch.size() >= maxBatchFiles || bytes + action.size > maxBatchBytes)) {
+                batches.append(batch);
+                batch.clear();
+                bytes = 0;
+            }
+            batch.append(action);
+            bytes += action.size;
+        }
+        if (!batch.isEmpty()) batches.append(batch);
+    }
+
+    QByteArray fileList(const QVector<SyncAction>& batch) const {
+        QByteArray list;
+        for (const SyncAction& action : batch) list += action.path.toUtf8() + '\n';
+        return list;
+    }
+
+    void nextStep() {
+        // Batches never share a path, so each gets a channel of its own.
+        while (!batches.isEmpty() && batchesRunning < qMax(1, executor->tuning().inFlight)) {
+            QVector<SyncAction> batch = batches.takeFirst();
+            ++batchesRunning;
+            if (batch.first().kind == SyncAction::DeleteRemote) removeRemote(batch);
+            else if (batch.first().kind == SyncAction::Upload) uploadBatch(batch);
+            else downloadBatch(batch);
+        }
+        if (batchesRunning > 0) return;
+
+        stepClock.start();
+        if (!deltas.isEmpty()) return deltaTransfer(deltas.takeFirst());
+
+        // What both sides now agree on becomes the base for the next run.
+        Manifest synced;
+        for (auto it = local.constBegin(); it != local.constEnd(); ++it) {
+            auto r = remote.constFind(it.key());
+            if (r != remote.constEnd() && sameContent(*it, *r)) synced.insert(it.key(), *it);
+        }
+        // Conflicts and failed transfers keep their old base, so the next run still
+        // sees both sides as changed instead of letting the newer mtime win.
+        for (auto it = base.constBegin(); it != base.constEnd(); ++it) {
+            if (!synced.contains(it.key()) && (local.contains(it.key()) || remote.contains(it.key())))
+                synced.insert(it.key(), *it);
+        }
+        store->saveManifest(hostKey, manifestKey(), synced);
+        emit finished(failures == 0, QString("%1 files transferred, %2 failed").arg(transferred).arg(failures));
+    }
+
+    void batchDone(const QVector<SyncAction>& batch, bool ok) {
+        --batchesRunning;
+        if (!ok) {
+            failures += batch.size();
+        } else {
+            transferred += batch.size();
+            qint64 bytes = 0;
+            for (const SyncAction& action : batch) {
+                bytes += action.size;
+                if (action.kind == SyncAction::Upload) remote.insert(action.path, local.value(action.path));
+                else if (action.kind == SyncAction::Download) local.insert(action.path, remote.value(action.path));
+                else remote.remove(action.path);
+            }
+            if (batch.first().kind != SyncAction::DeleteRemote) sampleBytes += bytes;
+            if (sampleBytes >= TransferTuning::minSampleBytes) {
+                executor->recordTransfer(sampleBytes, sampleClock.restart());
+                sampleBytes = 0;
+            }
+        }
+        nextStep();
+    }
+
+    void removeRemote(const QVector<SyncAction>& batch) {
+        emit progress(QString("Deleting %1 remote files...").arg(batch.size()));
+        QString cmd = QString("cd %1 && tr '\\n' '\\0' | xargs -0 rm -f --").arg(shellQuote(options.remoteRoot));
+        int id = executor->execute(cmd, SSHCommandExecutor::OutputHandler(),
+                                   [this, batch](int status) { batchDone(batch, status == 0); });
+        executor->write(id, fileList(batch));
+        executor->closeInput(id);
+    }
+
+    void downloadBatch(const QVector<SyncAction>& batch) {
+        emit progress(QString("Downloading %1 files...").arg(batch.size()));
+        QDir().mkpath(options.localRoot);
+        QProcess* untar = new QProcess(this);
+        untar->start("tar", QStringList() << "-xf" << "-" << "-C" << options.localRoot);
+
+        QString cmd = QString("cd %1 && tar -cf - -T -").arg(shellQuote(options.remoteRoot));
+        int id = executor->execute(cmd,
+            [untar](const QByteArray& data) { untar->write(data); },
+            [this, untar, batch](int status) {
+                untar->closeWriteChannel();
+                connect(untar, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this,
+                        [this, untar, batch, status](int code, QProcess::ExitStatus exitStatus) {
+                    untar->deleteLater();
+                    batchDone(batch, status == 0 && code == 0 && exitStatus == QProcess::NormalExit);
+                });
+            });
+        executor->write(id, fileList(batch));
+        executor->closeInput(id);
+    }
+
+    void uploadBatch(const QVector<SyncAction>& batch) {
+        emit progress(QString("Uploading %1 files...").arg(batch.size()));
+        QString cmd = QString("mkdir -p %1 && cd %1 && tar -xf -").arg(shellQuote(options.remoteRoot));
+        QSharedPointer<int> localStatus(new int(-1));
+        int id = executor->execute(cmd, SSHCommandExecutor::OutputHandler(),
+                                   [this, batch, localStatus](int status) { batchDone(batch, status == 0 && *localStatus == 0); });
+
+        QProcess* pack = new QProcess(this);
+        pack->setWorkingDirectory(options.localRoot);
+        connect(pack, &QProcess::readyReadStandardOutput, this, [this, pack, id]() {
+            executor->write(id, pack->readAllStandardOutput());
+        });
+        connect(pack, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this,
+                [this, pack, id, localStatus](int code, QProcess::ExitStatus exitStatus) {
+            executor->write(id, pack->readAllStandardOutput());
+            *localStatus = exitStatus == QProcess::NormalExit ? code : -1;
+            executor->closeInput(id);
+            pack->deleteLater();
+        });
+        pack->start("tar", QStringList() << "-cf" << "-" << "-T" << "-");
+        pack->write(fileList(batch));
+        pack->closeWriteChannel();
+    }
+
+    static QVector<QByteArray> blockHashes(const QString& path, qint64 limit) {
+        QVector<QByteArray> hashes;
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) return hashes;
+        QByteArray block;
+        while (file.pos() < limit && !(block = file.read(qMin(qint64(blockSize), limit - file.pos()))).isEmpty())
+            hashes.append(QCryptographicHash::hash(block, QCryptographicHash::Sha256).toHex());
+        return hashes;
+    }
+
+    // Compares 1 MiB block hashes on both sides and moves only the blocks that differ.
+    void deltaTransfer(const SyncAction& action) {
+        bool upload = action.kind == SyncAction::Upload;
+        QString localFile = options.localRoot + "/" + action.path;
+        QString remoteFile = options.remoteRoot + "/" + action.path;
+        qint64 localSize = local.value(action.path).size, remoteSize = remote.value(action.path).size;
+        // The agent cannot truncate, so shrinking a remote file needs a full copy,
+        // as does a helper that was switched off after the plan was made.
+        if (!agent->isReady() || (upload && localSize < remoteSize)) {
+            QVector<SyncAction> single(1, action);
+            batches.append(single);
+            return nextStep();
+        }
+        emit progress("Comparing blocks of " + action.path + "...");
+
+        qint64 compared = qMin(localSize, remoteSize);
+        QFutureWatcher<QVector<QByteArray>>* hashing = new QFutureWatcher<QVector<QByteArray>>(this);
+        connect(hashing, &QFutureWatcher<QVector<QByteArray>>::finished, this,
+                [this, hashing, action, remoteFile, compared, upload, localSize, remoteSize]() {
+            QVector<QByteArray> localHashes = hashing->result();
+            hashing->deleteLater();
+            int blocks = localHashes.size();
+            QSharedPointer<QList<qint64>> changed(new QList<qint64>);
+            QSharedPointer<int> answered(new int(0));
+            qint64 total = upload ? localSize : remoteSize;
+            for (qint64 offset = qint64(blocks) * blockSize; offset < total; offset += blockSize) changed->append(offset);
+            if (blocks == 0) return moveBlocks(action, changed, upload);
+
+            for (int i = 0; i < blocks; ++i) {
+                qint64 offset = qint64(i) * blockSize;
+                QStringList args;
+                args << remoteFile << QString::number(offset) << QString::number(qMin(qint64(blockSize), compared - offset));
+                auto compare = [=](int status, const QByteArray& payload) {
+                    if (status != 0 || payload.trimmed() != localHashes[i]) changed->append(offset);
+                    if (++*answered == blocks) moveBlocks(action, changed, upload);
+                };
+                if (!agent->request("hash", args, QByteArray(), compare)) compare(-1, QByteArray());
+            }
+        });
+        hashing->setFuture(QtConcurrent::run(blockHashes, localFile, compared));
+    }
+
+    void moveBlocks(const SyncAction& action, QSharedPointer<QList<qint64>> offsets, bool upload) {
+        blockFile.reset(new QFile(options.localRoot + "/" + action.path));
+        if (!blockFile->open(upload ? QIODevice::ReadOnly : QIODevice::ReadWrite)) {
+            ++failures;
+            return nextStep();
+        }
+        blockAction = action;
+        blockUpload = upload;
+        blockQueue = *offsets;
+        std::sort(blockQueue.begin(), blockQueue.end());
+        blocksInFlight = 0;
+        blockBytes = 0;
+        blocksOk = true;
+        pumpBlocks();
+    }
+
+    void pumpBlocks() {
+        QString remoteFile = options.remoteRoot + "/" + blockAction.path;
+        // The window follows the host's tuning, which these transfers feed in turn.
+        while (blocksOk && !blockQueue.isEmpty() && blocksInFlight < executor->tuning().inFlight) {
+            qint64 offset = blockQueue.takeFirst();
+            ++blocksInFlight;
+            if (blockUpload) {
+                blockFile->seek(offset);
+                QByteArray block = blockFile->read(blockSize);
+                blockBytes += block.size();
+                quint32 sent = agent->request("write", QStringList() << remoteFile << QString::number(offset), block,
+                                              [this](int status, const QByteArray&) {
+                    --blocksInFlight;
+                    if (status != 0) blocksOk = false;
+                    pumpBlocks();
+                });
+                if (!sent) {
+                    --blocksInFlight;
+                    blocksOk = false;
+                }
+            } else {
+                QStringList args;
+                args << remoteFile << QString::number(offset) << QString::number(blockSize);
+                quint32 sent = agent->request("read", args, QByteArray(), [this, offset](int status, const QByteArray& payload) {
+                    --blocksInFlight;
+                    if (status != 0 || !blockFile->seek(offset) || blockFile->write(payload) != payload.size()) blocksOk = false;
+                    blockBytes += payload.size();
+                    pumpBlocks();
+                });
+                if (!sent) {
+                    --blocksInFlight;
+                    blocksOk = false;
+                }
+            }
+        }
+        if (blocksInFlight == 0 && (blockQueue.isEmpty() || !blocksOk)) {
+            QSharedPointer<QFile> file = blockFile;
+            blockFile.reset();
+            finishDelta(blockAction, file, blocksOk, blockUpload);
+        }
+    }
+
+    void finishDelta(const SyncAction& action, QSharedPointer<QFile> file, bool ok, bool upload) {
+        ManifestEntry entry = upload ? local.value(action.path) : remote.value(action.path);
+        if (!upload && ok) {
+            ok = file->resize(entry.size) &&
+                 file->setFileTime(QDateTime::fromMSecsSinceEpoch(entry.mtime), QFileDevice::FileModificationTime);
+        }
+        file->close();
+        if (ok) executor->recordTransfer(blockBytes, stepClock.elapsed());
+        if (!ok || !upload) {
+            if (ok) local.insert(action.path, entry);
+            ok ? ++transferred : ++failures;
+            return nextStep();
+        }
+        // Carry the local mtime over so both sides compare equal next time.
+        QString cmd = QString("touch -m -d @%1 %2").arg(entry.mtime / 1000).arg(shellQuote(options.remoteRoot + "/" + action.path));
+        executor->execute(cmd, SSHCommandExecutor::OutputHandler(), [this, action, entry](int status) {
+            ManifestEntry synced = entry;
+            synced.mtime = entry.mtime / 1000 * 1000;
+            if (status == 0) remote.insert(action.path, synced);
+            status == 0 ? ++transferred : ++failures;
+            nextStep();
+        });
+    }
+};
+
+class SyncDialog : public QDialog {
+    Q_OBJECT
+    SyncEngine* engine;
+    QLineEdit *localEdit, *remoteEdit;
+    QCheckBox *hashBox, *incrementalBox;
+    QPlainTextEdit* planView;
+    QLabel* status;
+    QPushButton *planBtn, *executeBtn;
+
+public:
+    SyncDialog(SyncEngine* syncEngine, const QString& remotePath, QWidget* parent = nullptr) : QDialog(parent), engine(syncEngine) {
+        setWindowTitle("Sync Directories");
+        resize(700, 500);
+        QVBoxLayout* layout = new QVBoxLayout(this);
+
+        QHBoxLayout* localRow = new QHBoxLayout;
+        localEdit = new QLineEdit;
+        QPushButton* browseBtn = new QPushButton("Browse...");
+        localRow->addWidget(new QLabel("Local:"));
+        localRow->addWidget(localEdit);
+        localRow->addWidget(browseBtn);
+        layout->addLayout(localRow);
+
+        QHBoxLayout* remoteRow = new QHBoxLayout;
+        remoteEdit = new QLineEdit(remotePath);
+        remoteRow->addWidget(new QLabel("Remote:"));
+        remoteRow->addWidget(remoteEdit);
+        layout->addLayout(remoteRow);
+
+        QHBoxLayout* optionRow = new QHBoxLayout;
+        hashBox = new QCheckBox("Compare hashes");
+        incrementalBox = new QCheckBox("Incremental (reuse last manifest)");
+        incrementalBox->setChecked(true);
+        optionRow->addWidget(hashBox);
+        optionRow->addWidget(incrementalBox);
+        layout->addLayout(optionRow);
+
+        planView = new QPlainTextEdit;
+        planView->setReadOnly(true);
+        layout->addWidget(planView);
+        status = new QLabel;
+        layout->addWidget(status);
+
+        QHBoxLayout* buttonRow = new QHBoxLayout;
+        planBtn = new QPushButton("Plan (dry run)");
+        executeBtn = new QPushButton("Execute");
+        executeBtn->setEnabled(false);
+        buttonRow->addStretch();
+        buttonRow->addWidget(planBtn);
+        buttonRow->addWidget(executeBtn);
+        layout->addLayout(buttonRow);
+
+        connect(browseBtn, &QPushButton::clicked, this, [this]() {
+            QString dir = QFileDialog::getExistingDirectory(this, "Local Directory", localEdit->text());
+            if (!dir.isEmpty()) localEdit->setText(dir);
+        });
+        connect(planBtn, &QPushButton::clicked, this, [this]() {
+            if (localEdit->text().isEmpty() || remoteEdit->text().isEmpty()) return;
+            SyncEngine::Options options;
+            options.localRoot = localEdit->text();
+            options.remoteRoot = remoteEdit->text();
+            options.withHashes = hashBox->isChecked();
+            options.incremental = incrementalBox->isChecked();
+            options.dryRun = true;
+            planView->clear();
+            planBtn->setEnabled(false);
+            executeBtn->setEnabled(false);
+            engine->start(options);
+        });
+        connect(executeBtn, &QPushButton::clicked, this, [this]() {
+            planBtn->setEnabled(false);
+            executeBtn->setEnabled(false);
+            engine->execute();
+        });
+        connect(engine, &SyncEngine::progress, status, &QLabel::setText);
+        connect(engine, &SyncEngine::planReady, this, [this]() {
+            QStringList lines;
+            for (const SyncAction& action : engine->currentPlan()) lines << SyncEngine::describe(action);
+            planView->setPlainText(lines.isEmpty() ? "Already in sync." : lines.join('\n'));
+            executeBtn->setEnabled(!lines.isEmpty());
+        });
+        connect(engine, &SyncEngine::finished, this, [this](bool, const QString& summary) {
+            status->setText(summary);
+            planBtn->setEnabled(true);
+        });
+    }
+};
+
+// Runs one command on many hosts at once, each over its own session thread. At
+// most maxParallel hosts are in flight; a host that has not finished within
+// the timeout, connection included, is dropped and reported as timed out.
+class FanOutRunner : public QObject {
+    Q_OBJECT
+    struct HostRun {
+        int index = 0;
+        SavedConnection connection;
+        SessionClient* client = nullptr;
+        QTimer* deadline = nullptr;
+        QElapsedTimer clock;
+        bool done = false;
+    };
+
+    QVector<QSharedPointer<HostRun>> runs;
+    QString command;
+    int nextRun = 0;
+    int active = 0;
+    int maxParallel = 32;
+    int timeoutMs = 30000;
+
+public:
+    FanOutRunner(QObject* parent = nullptr) : QObject(parent) {}
+    ~FanOutRunner() {
+        // Receivers may already be half destroyed when the runner goes with its parent.
+        blockSignals(true);
+        cancel();
+    }
+
+    bool isRunning() const { return active > 0 || nextRun < runs.size(); }
+
+    void start(const QList<SavedConnection>& hosts, const QString& cmd, int parallel, int timeout) {
+        cancel();
+        runs.clear();
+        for (const SavedConnection& connection : hosts) {
+            QSharedPointer<HostRun> run(new HostRun);
+            run->index = runs.size();
+            run->connection = connection;
+            runs.append(run);
+        }
+        command = cmd;
+        maxParallel = qMax(1, parallel);
+        timeoutMs = timeout;
+        nextRun = 0;
+        active = 0;
+        launchMore();
+    }
+
+    // Stops every host still queued or running; they are reported with status -1.
+    void cancel() {
+        // Hosts that never launched are reported here; running ones report through
+        // hostDone, the last of which emits allFinished. Only with none running is
+        // allFinished left to this function.
+        bool dropped = nextRun < runs.size();
+        bool wasIdle = active == 0;
+        for (int i = nextRun; i < runs.size(); ++i) {
+            runs[i]->done = true;
+            emit hostFinished(i, -1, 0, false);
+        }
+        nextRun = runs.size();
+        for (const QSharedPointer<HostRun>& run : runs)
+            if (run->client && !run->done) hostDone(run, -1, false);
+        if (dropped && wasIdle) emit allFinished();
+    }
+
+signals:
+    void hostStarted(int index);
+    void hostOutput(int index, const QByteArray& data);
+    void hostFinished(int index, int exitStatus, qint64 elapsedMs, bool timedOut);
+    void allFinished();
+
+private:
+    void launchMore() {
+        while (active < maxParallel && nextRun < runs.size()) launch(runs[nextRun++]);
+        if (active == 0 && nextRun >= runs.size()) emit allFinished();
+    }
+
+    void launch(QSharedPointer<HostRun> run) {
+        ++active;
+        run->clock.start();
+        run->client = new SessionClient(run->connection.key(), this);
+        run->deadline = new QTimer(this);
+        run->deadline->setSingleShot(true);
+        connect(run->deadline, &QTimer::timeout, this, [this, run]() { hostDone(run, -1, true); });
+        connect(run->client, &SessionClient::connectionFailed, this, [this, run](const QString& error) {
+            emit hostOutput(run->index, "connection failed: " + error.toUtf8() + "\n");
+            hostDone(run, -1, false);
+        });
+        emit hostStarted(run->index);
+
+        run->client->execute(command,
+            [this, run](const QByteArray& data) { emit hostOutput(run->index, data); },
+            [this, run](int status) { hostDone(run, status, false); });
+        run->client->connectToHost(run->connection.host, run->connection.user, run->connection.password);
+        run->deadline->start(timeoutMs);
+    }
+
+    void hostDone(QSharedPointer<HostRun> run, int status, bool timedOut) {
+        if (run->done) return;
+        run->done = true;
+        --active;
+        run->deadline->deleteLater();
+
+        run->client->deleteLater();
+        run->client = nullptr;
+
+        emit hostFinished(run->index, status, run->clock.elapsed(), timedOut);
+        launchMore();
+    }
+};
+
+// Picks saved hosts and a command, then shows per-host output panes next to
+// a summary of exit status and duration for every host.
+class FanOutDialog : public QDialog {
+    Q_OBJECT
+    ListingSnapshotStore* store;
+    FanOutRunner* runner;
+    QList<SavedConnection> connections;
+    QList<SavedConnection> selected;
+    QElapsedTimer runClock;
+    int succeeded = 0, failed = 0, timedOut = 0;
+
+    QListWidget* hostList;
+    QComboBox* commandBox;
+    QSpinBox *parallelBox, *timeoutBox;
+    QPushButton *runBtn, *stopBtn;
+    QTabWidget* panes;
+    QTableWidget* summary;
+    QLabel* totals;
+    QMap<int, ConsoleView*> hostPanes;
+
+public:
+    FanOutDialog(ListingSnapshotStore* snapshots, const QMap<QString, QString>& actions, QWidget* parent = nullptr)
+        : QDialog(parent), store(snapshots) {
+        setWindowTitle("Run on Hosts");
+        resize(900, 600);
+        runner = new FanOutRunner(this);
+
+        QHBoxLayout* layout = new QHBoxLayout(this);
+        QVBoxLayout* side = new QVBoxLayout;
+        hostList = new QListWidget;
+        QPushButton* addHostBtn = new QPushButton("Add Host...");
+        QPushButton* allBtn = new QPushButton("Select All");
+        side->addWidget(new QLabel("Hosts:"));
+        side->addWidget(hostList);
+        side->addWidget(addHostBtn);
+        side->addWidget(allBtn);
+
+        commandBox = new QComboBox;
+        commandBox->setEditable(true);
+        for (auto it = actions.constBegin(); it != actions.constEnd(); ++it) commandBox->addItem(it.value());
+        side->addWidget(new QLabel("Command:"));
+        side->addWidget(commandBox);
+
+        parallelBox = new QSpinBox;
+        parallelBox->setRange(1, 256);
+        parallelBox->setValue(32);
+        parallelBox->setPrefix("Parallel: ");
+        timeoutBox = new QSpinBox;
+        timeoutBox->setRange(1, 3600);
+        timeoutBox->setValue(30);
+        timeoutBox->setPrefix("Timeout: ");
+        timeoutBox->setSuffix(" s");
+        side->addWidget(parallelBox);
+        side->addWidget(timeoutBox);
+
+        runBtn = new QPushButton("Run");
+        stopBtn = new QPushButton("Stop");
+        stopBtn->setEnabled(false);
+        side->addWidget(runBtn);
+        side->addWidget(stopBtn);
+        layout->addLayout(side);
+
+        QVBoxLayout* results = new QVBoxLayout;
+        panes = new QTabWidget;
+        summary = new QTableWidget(0, 3);
+        summary->setHorizontalHeaderLabels(QStringList() << "Host" << "Exit" << "Time");
+        summary->horizontalHeader()->setStretchLastSection(true);
+        summary->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        panes->addTab(summary, "Summary");
+        totals = new QLabel;
+        results->addWidget(panes);
+        results->addWidget(totals);
+        layout->addLayout(results, 1);
+
+        reloadHosts();
+
+        connect(addHostBtn, &QPushButton::clicked, this, &FanOutDialog::addHost);
+        connect(allBtn, &QPushButton::clicked, this, [this]() {
+            for (int i = 0; i < hostList->count(); ++i) hostList->item(i)->setCheckState(Qt::Checked);
+        });
+        connect(runBtn, &QPushButton::clicked, this, &FanOutDialog::run);
+        connect(stopBtn, &QPushButton::clicked, runner, &FanOutRunner::cancel);
+        connect(summary, &QTableWidget::cellDoubleClicked, this, [this](int row, int) {
+            if (hostPanes.contains(row)) panes->setCurrentWidget(hostPanes[row]);
+        });
+
+        connect(runner, &FanOutRunner::hostStarted, this, [this](int index) {
+            summary->item(index, 1)->setText("running");
+        });
+        connect(runner, &FanOutRunner::hostOutput, this, [this](int index, const QByteArray& data) {
+            paneFor(index)->appendOutput(data);
+        });
+        connect(runner, &FanOutRunner::hostFinished, this, [this](int index, int status, qint64 ms, bool expired) {
+            summary->item(index, 1)->setText(expired ? "timeout" : QString::number(status));
+            summary->item(index, 2)->setText(QString("%1 ms").arg(ms));
+            if (hostPanes.contains(index)) hostPanes[index]->flush(true);
+            if (expired) ++timedOut;
+            else if (status == 0) ++succeeded;
+            else ++failed;
+            updateTotals();
+        });
+        connect(runner, &FanOutRunner::allFinished, this, [this]() {
+            runBtn->setEnabled(true);
+            stopBtn->setEnabled(false);
+            updateTotals();
+        });
+    }
+
+private:
+    void reloadHosts() {
+        hostList->clear();
+        connections = store->savedConnections();
+        for (const SavedConnection& connection : connections) {
+            QListWidgetItem* item = new QListWidgetItem(connection.key(), hostList);
+            item->setCheckState(Qt::Unchecked);
+        }
+    }
+
+    void addHost() {
+        QString target = QInputDialog::getText(this, "Add Host", "user@host:");
+        int at = target.indexOf('@');
+        if (at <= 0 || at == target.size() - 1) return;
+        QString password = QInputDialog::getText(this, "Add Host", "Password:", QLineEdit::Password);
+        store->saveConnection(target.mid(at + 1), target.left(at), password);
+        reloadHosts();
+    }
+
+    void run() {
+        QString command = commandBox->currentText().trimmed();
+        selected.clear();
+        for (int i = 0; i < hostList->count(); ++i)
+            if (hostList->item(i)->checkState() == Qt::Checked) selected << connections[i];
+        if (command.isEmpty() || selected.isEmpty()) return;
+
+        for (ConsoleView* pane : hostPanes) delete pane;
+        hostPanes.clear();
+        summary->setRowCount(selected.size());
+        for (int i = 0; i < selected.size(); ++i) {
+            summary->setItem(i, 0, new QTableWidgetItem(selected[i].key()));
+            summary->setItem(i, 1, new QTableWidgetItem("queued"));
+            summary->setItem(i, 2, new QTableWidgetItem);
+        }
+        succeeded = failed = timedOut = 0;
+        runClock.start();
+        runBtn->setEnabled(false);
+        stopBtn->setEnabled(true);
+        runner->start(selected, command, parallelBox->value(), timeoutBox->value() * 1000);
+    }
+
+    // Panes are created on first output so quiet hosts cost nothing.
+    ConsoleView* paneFor(int index) {
+        ConsoleView*& pane = hostPanes[index];
+        if (!pane) {
+            pane = new ConsoleView;
+            panes->addTab(pane, selected[index].key());
+        }
+        return pane;
+    }
+
+    void updateTotals() {
+        int done = succeeded + failed + timedOut;
+        totals->setText(QString("%1/%2 done: %3 ok, %4 failed, %5 timed out, %6 ms")
+                            .arg(done).arg(selected.size()).arg(succeeded).arg(failed).arg(timedOut).arg(runClock.elapsed()));
+    }
+};
+
+struct SearchMatch {
+    QString path;  // relative to the search root
+    int line = 0;
+    QString text;
+};
+
+// Content search over a remote tree. rg is used when the host has it and
+// grep -rnI otherwise; both print "path\0line:text" records, which are parsed
+// as they stream in. The search stops itself once maxResults have arrived.
+class ContentSearch : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        bool regex = false;
+        bool caseInsensitive = false;
+        int maxResults = 2000;
+    };
 
-    bool connectToHost(const QString& host, const QString& user, const QString& password) {
-        session = ssh_new();
-        if (!session) return false;
-        ssh_options_set(session, SSH_OPTIONS_HOST, host.toStdString().c_str());
-        ssh_options_set(session, SSH_OPTIONS_USER, user.toStdString().c_str());
+private:
+    SessionClient* executor;
+    int searchId = 0;
+    int found = 0;
+    Options options;
 
-        if (ssh_connect(session) != SSH_OK)
-            return false;
+public:
+    ContentSearch(SessionClient* exec, QObject* parent = nullptr) : QObject(parent), executor(exec) {}
+    ~ContentSearch() { cancel(); }
 
-        if (ssh_userauth_password(session, nullptr, password.toStdString().c_str()) != SSH_AUTH_SUCCESS)
-            return false;
+    bool isRunning() const { return searchId != 0; }
 
-        return true;
+    void start(const QString& root, const QString& pattern, const Options& opts) {
+        cancel();
+        options = opts;
+        found = 0;
+
+        // Both tools take the same extended regex syntax; rg is told to search hidden
+        // and ignored files too, so its results match grep -r.
+        QString caseFlag = opts.caseInsensitive ? " -i" : "";
+        QString rgFlags = QString(opts.regex ? "" : " -F") + caseFlag;
+        QString grepFlags = QString(opts.regex ? " -E" : " -F") + caseFlag;
+        // sshd leaves the command running when the channel closes, so the search runs
+        // in the background next to a loop that kills it once stdin reaches EOF, which
+        // is what closing the channel delivers. Background jobs get /dev/null as stdin,
+        // hence the copy on fd 3.
+        QString cmd = QString("cd %1 || exit 2; if command -v rg >/dev/null 2>&1; "
+                              "then set -- rg -n --no-heading --null --color never --hidden --no-ignore%2 -- %4 .; "
+                              "else set -- grep -rnI --null%3 -- %4 .; fi; "
+                              "exec 3<&0; \"$@\" & search=$!; "
+                              "{ while read -r _ <&3; do :; done; kill $search; } >/dev/null 2>&1 & watch=$!; "
+                              "wait $search; status=$?; kill $watch 2>/dev/null; exit $status")
+                          .arg(shellQuote(root), rgFlags, grepFlags, shellQuote(pattern));
+
+        QSharedPointer<ChunkBuffer> buffer(new ChunkBuffer);
+        QSharedPointer<int> id(new int(0));
+        *id = searchId = executor->execute(cmd,
+            [this, buffer, id](const QByteArray& data) {
+                memcpy(buffer->prepare(data.size()), data.constData(), data.size());
+                buffer->commit(data.size());
+                QVector<SearchMatch> batch;
+                QString line;
+                while (found + batch.size() < options.maxResults && buffer->takeLine(line)) parseRecord(line, batch);
+                publish(batch);
+                if (found >= options.maxResults && searchId == *id) {
+                    // Closing the channel ends the search's stdin, which kills it.
+                    cancel();
+                    emit finished(true);
+                }
+            },
+            [this, buffer, id](int) {
+                if (searchId != *id) return;
+                QVector<SearchMatch> batch;
+                QString line;
+                while (found + batch.size() < options.maxResults && buffer->takeLine(line, true)) parseRecord(line, batch);
+                publish(batch);
+                searchId = 0;
+                emit finished(false);
+            });
     }
 
-    QStringList runCommand(const QString& cmd) {
-        QStringList output;
-        if (!session) return output;
+    void cancel() {
+        if (!searchId) return;
+        executor->cancel(searchId);
+        searchId = 0;
+    }
 
-        ssh_channel channel = ssh_channel_new(session);
-        if (!channel) return output;
+signals:
+    void matchesFound(const QVector<SearchMatch>& matches);
+    // capped is set when the search stopped at maxResults.
+    void finished(bool capped);
 
-        if (ssh_channel_open_session(channel) != SSH_OK) return output;
-        if (ssh_channel_request_exec(channel, cmd.toStdString().c_str()) != SSH_OK) {
-            ssh_channel_close(channel);
-            ssh_channel_free(channel);
-            return output;
+private:
+    static void parseRecord(const QString& record, QVector<SearchMatch>& out) {
+        int nul = record.indexOf(QChar(0));
+        int colon = record.indexOf(':', nul + 1);
+        if (nul <= 0 || colon < 0) return;
+        SearchMatch match;
+        match.path = record.left(nul);
+        if (match.path.startsWith("./")) match.path.remove(0, 2);
+        match.line = record.midRef(nul + 1, colon - nul - 1).toInt();
+        match.text = record.mid(colon + 1, 300);
+        out.append(match);
+    }
+
+    void publish(const QVector<SearchMatch>& batch) {
+        if (batch.isEmpty()) return;
+        found += batch.size();
+        emit matchesFound(batch);
+    }
+};
+
+// Read-only text view of a remote file, fetched a page of lines at a time.
+class TextPreviewDialog : public QDialog {
+    Q_OBJECT
+    static const int pageLines = 400;
+
+    SessionClient* executor;
+    QString path;
+    int firstLine = 1;
+    int focusLine = 0;
+    int pageId = 0;
+    QPlainTextEdit* view;
+    QLabel* position;
+    QPushButton *prevBtn, *nextBtn;
+
+public:
+    TextPreviewDialog(SessionClient* exec, const QString& filePath, int line = 1, QWidget* parent = nullptr)
+        : QDialog(parent), executor(exec), path(filePath), focusLine(line) {
+        setWindowTitle(filePath);
+        resize(800, 600);
+        QVBoxLayout* layout = new QVBoxLayout(this);
+        view = new QPlainTextEdit;
+        view->setReadOnly(true);
+        view->setLineWrapMode(QPlainTextEdit::NoWrap);
+        view->setFont(QFont("monospace"));
+        layout->addWidget(view);
+
+        QHBoxLayout* nav = new QHBoxLayout;
+        prevBtn = new QPushButton("Previous Page");
+        nextBtn = new QPushButton("Next Page");
+        position = new QLabel;
+        nav->addWidget(prevBtn);
+        nav->addWidget(position, 1);
+        nav->addWidget(nextBtn);
+        layout->addLayout(nav);
+
+        connect(prevBtn, &QPushButton::clicked, this, [this]() { loadPage(qMax(1, firstLine - pageLines)); });
+        connect(nextBtn, &QPushButton::clicked, this, [this]() { loadPage(firstLine + pageLines); });
+        loadPage(qMax(1, line - pageLines / 2));
+    }
+
+    ~TextPreviewDialog() {
+        if (pageId) executor->cancel(pageId);
+    }
+
+private:
+    void loadPage(int first) {
+        if (pageId) executor->cancel(pageId);
+        firstLine = first;
+        int last = first + pageLines - 1;
+        prevBtn->setEnabled(false);
+        nextBtn->setEnabled(false);
+        position->setText("Loading...");
+
+        QSharedPointer<QByteArray> text(new QByteArray);
+        QString cmd = QString("sed -n '%1,%2p;%2q' %3").arg(first).arg(last).arg(shellQuote(path));
+        pageId = executor->execute(cmd,
+            [text](const QByteArray& data) { text->append(data); },
+            [this, text, first](int) {
+                pageId = 0;
+                view->setPlainText(QString::fromUtf8(*text));
+                int lines = view->document()->blockCount() - (text->endsWith('\n') ? 1 : 0);
+                position->setText(QString("Lines %1-%2").arg(first).arg(first + qMax(lines, 1) - 1));
+                prevBtn->setEnabled(first > 1);
+                nextBtn->setEnabled(lines >= pageLines);
+                highlight(focusLine - first);
+            });
+    }
+
+    void highlight(int block) {
+        QTextBlock target = view->document()->findBlockByNumber(block);
+        if (!target.isValid()) return;
+        QTextEdit::ExtraSelection selection;
+        selection.format.setBackground(QColor(255, 240, 150));
+        selection.format.setProperty(QTextFormat::FullWidthSelection, true);
+        selection.cursor = QTextCursor(target);
+        view->setExtraSelections(QList<QTextEdit::ExtraSelection>() << selection);
+        view->setTextCursor(selection.cursor);
+        view->centerCursor();
+    }
+};
+
+// Search-in-files panel; matches fill in as the remote search streams them.
+class SearchDialog : public QDialog {
+    Q_OBJECT
+    ContentSearch* search;
+    QString root;
+    QLineEdit* patternEdit;
+    QCheckBox *regexBox, *caseBox;
+    QPushButton *searchBtn, *stopBtn;
+    QListWidget* results;
+    QLabel* status;
+
+public:
+    SearchDialog(SessionClient* executor, const QString& rootPath, QWidget* parent = nullptr)
+        : QDialog(parent), root(rootPath) {
+        setWindowTitle("Search in " + rootPath);
+        resize(800, 500);
+        search = new ContentSearch(executor, this);
+
+        QVBoxLayout* layout = new QVBoxLayout(this);
+        QHBoxLayout* queryRow = new QHBoxLayout;
+        patternEdit = new QLineEdit;
+        patternEdit->setPlaceholderText("Text to find");
+        regexBox = new QCheckBox("Regex");
+        caseBox = new QCheckBox("Ignore case");
+        searchBtn = new QPushButton("Search");
+        stopBtn = new QPushButton("Stop");
+        stopBtn->setEnabled(false);
+        queryRow->addWidget(patternEdit, 1);
+        queryRow->addWidget(regexBox);
+        queryRow->addWidget(caseBox);
+        queryRow->addWidget(searchBtn);
+        queryRow->addWidget(stopBtn);
+        layout->addLayout(queryRow);
+
+        results = new QListWidget;
+        results->setUniformItemSizes(true);
+        layout->addWidget(results);
+        status = new QLabel;
+        layout->addWidget(status);
+
+        connect(patternEdit, &QLineEdit::returnPressed, this, &SearchDialog::run);
+        connect(searchBtn, &QPushButton::clicked, this, &SearchDialog::run);
+        connect(stopBtn, &QPushButton::clicked, this, [this]() {
+            search->cancel();
+            showFinished(false, true);
+        });
+        connect(search, &ContentSearch::matchesFound, this, [this](const QVector<SearchMatch>& matches) {
+            for (const SearchMatch& match : matches) {
+                QListWidgetItem* item = new QListWidgetItem(QString("%1:%2: %3").arg(match.path).arg(match.line).arg(match.text.trimmed()));
+                item->setData(Qt::UserRole, joinPath(root, match.path));
+                item->setData(Qt::UserRole + 1, match.line);
+                results->addItem(item);
+            }
+            status->setText(QString("%1 matches...").arg(results->count()));
+        });
+        connect(search, &ContentSearch::finished, this, [this](bool capped) { showFinished(capped, false); });
+        connect(results, &QListWidget::itemActivated, this, [this, executor](QListWidgetItem* item) {
+            TextPreviewDialog* preview = new TextPreviewDialog(executor, item->data(Qt::UserRole).toString(),
+                                                               item->data(Qt::UserRole + 1).toInt(), this);
+            preview->setAttribute(Qt::WA_DeleteOnClose);
+            preview->show();
+        });
+    }
+
+private:
+    void run() {
+        if (patternEdit->text().isEmpty()) return;
+        ContentSearch::Options options;
+        options.regex = regexBox->isChecked();
+        options.caseInsensitive = caseBox->isChecked();
+        results->clear();
+        status->setText("Searching...");
+        searchBtn->setEnabled(false);
+        stopBtn->setEnabled(true);
+        search->start(root, patternEdit->text(), options);
+    }
+
+    void showFinished(bool capped, bool stopped) {
+        searchBtn->setEnabled(true);
+        stopBtn->setEnabled(false);
+        QString note = capped ? " (result limit reached)" : stopped ? " (stopped)" : "";
+        status->setText(QString("%1 matches%2").arg(results->count()).arg(note));
+    }
+};
+
+static QString formatSize(qint64 bytes) {
+    static const char* const units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    double value = bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        ++unit;
+    }
+    return unit == 0 ? QString("%1 B").arg(bytes) : QString("%1 %2").arg(value, 0, 'f', 1).arg(units[unit]);
+}
+
+// Prefix tree of a scanned directory with sizes rolled up into every
+// ancestor. Nodes are fixed-size records in one array linked by index and
+// names live back to back in a single pool, so ten million entries fit in a
+// few hundred MB. Insertion keeps the path of the previous entry: scanners
+// emit a directory's contents contiguously, so a component that differs
+// from that path is always new and never needs a lookup among siblings.
+class DiskUsageTree {
+public:
+    static const quint32 none = 0xffffffffu;
+
+private:
+    struct Node {
+        qint64 size;
+        quint32 parent;
+        quint32 firstChild;
+        quint32 nextSibling;
+        quint32 nameOffset;
+        quint32 files;
+        quint16 nameLength;
+    };
+
+    std::vector<Node> nodes;
+    QByteArray names;
+    std::vector<quint32> lastPath;
+
+public:
+    DiskUsageTree() { clear(); }
+
+    void clear() {
+        nodes.assign(1, Node{ 0, none, none, none, 0, 0, 0 });
+        names.clear();
+        lastPath.assign(1, 0);
+    }
+
+    quint32 root() const { return 0; }
+    quint32 nodeCount() const { return quint32(nodes.size()); }
+    qint64 size(quint32 node) const { return nodes[node].size; }
+    quint32 files(quint32 node) const { return nodes[node].files; }
+    quint32 parent(quint32 node) const { return nodes[node].parent; }
+    bool hasChildren(quint32 node) const { return nodes[node].firstChild != none; }
+
+    QString name(quint32 node) const {
+        return QString::fromUtf8(names.constData() + nodes[node].nameOffset, nodes[node].nameLength);
+    }
+
+    QString path(quint32 node) const {
+        QStringList parts;
+        for (; node != 0 && node != none; node = nodes[node].parent) parts.prepend(name(node));
+        return parts.join('/');
+    }
+
+    // Children ordered by size, largest first.
+    std::vector<quint32> children(quint32 node) const {
+        std::vector<quint32> result;
+        for (quint32 child = nodes[node].firstChild; child != none; child = nodes[child].nextSibling) result.push_back(child);
+        std::sort(result.begin(), result.end(), [this](quint32 a, quint32 b) { return nodes[a].size > nodes[b].size; });
+        return result;
+    }
+
+    // Adds a file given by its '/'-separated path relative to the root.
+    void add(const char* path, int length, qint64 bytes) {
+        size_t depth = 0;
+        const char* end = path + length;
+        while (path < end) {
+            const char* slash = static_cast<const char*>(memchr(path, '/', end - path));
+            const char* stop = slash ? slash : end;
+            int componentLength = int(qMin<ptrdiff_t>(stop - path, 0xffff));
+            if (componentLength > 0) {
+                ++depth;
+                if (depth >= lastPath.size() || !nameEquals(lastPath[depth], path, componentLength)) {
+                    lastPath.resize(depth);
+                    lastPath.push_back(addChild(lastPath[depth - 1], path, componentLength));
+                }
+            }
+            path = stop + 1;
         }
+        for (size_t i = 0; i <= depth; ++i) {
+            Node& node = nodes[lastPath[i]];
+            node.size += bytes;
+            ++node.files;
+        }
+    }
+
+private:
+    bool nameEquals(quint32 node, const char* name, int length) const {
+        return nodes[node].nameLength == length && memcmp(names.constData() + nodes[node].nameOffset, name, length) == 0;
+    }
 
-        char buffer[4096];
-        int nbytes;
-        while ((nbytes = ssh_channel_read(channel, buffer, sizeof(buffer), 0)) > 0) {
-            output.append(QString::fromUtf8(buffer, nbytes).split('\n'));
+    quint32 addChild(quint32 parent, const char* name, int length) {
+        quint32 index = quint32(nodes.size());
+        nodes.push_back(Node{ 0, parent, none, nodes[parent].firstChild, quint32(names.size()), 0, quint16(length) });
+        nodes[parent].firstChild = index;
+        names.append(name, length);
+        return index;
+    }
+};
+
+// Streams "size path\0" records for every non-directory under a remote
+// root into a DiskUsageTree as they arrive.
+class DiskUsageScan : public QObject {
+    Q_OBJECT
+    SessionClient* executor;
+    DiskUsageTree* tree;
+    QByteArray carry;
+    int scanId = 0;
+    qint64 entries = 0;
+
+public:
+    DiskUsageScan(SessionClient* exec, DiskUsageTree* usageTree, QObject* parent = nullptr)
+        : QObject(parent), executor(exec), tree(usageTree) {}
+    ~DiskUsageScan() { cancel(); }
+
+    bool isRunning() const { return scanId != 0; }
+    qint64 entryCount() const { return entries; }
+
+    void start(const QString& root) {
+        cancel();
+        tree->clear();
+        carry.clear();
+        entries = 0;
+        QString cmd = QString("cd %1 && find . -xdev ! -type d -printf '%s %P\\0'").arg(shellQuote(root));
+        scanId = executor->execute(cmd,
+            [this](const QByteArray& data) { consume(data.constData(), data.size()); },
+            [this](int status) {
+                scanId = 0;
+                emit finished(status == 0);
+            });
+    }
+
+    void cancel() {
+        if (!scanId) return;
+        executor->cancel(scanId);
+        scanId = 0;
+    }
+
+signals:
+    // ok is false when find reported errors, usually unreadable directories.
+    void finished(bool ok);
+
+private:
+    void consume(const char* data, int size) {
+        const char* end = data + size;
+        if (!carry.isEmpty()) {
+            const char* nul = static_cast<const char*>(memchr(data, '\0', size));
+            if (!nul) {
+                carry.append(data, size);
+                return;
+            }
+            carry.append(data, int(nul - data));
+            addRecord(carry.constData(), carry.size());
+            carry.clear();
+            data = nul + 1;
+        }
+        while (data < end) {
+            const char* nul = static_cast<const char*>(memchr(data, '\0', end - data));
+            if (!nul) {
+                carry.append(data, int(end - data));
+                return;
+            }
+            addRecord(data, int(nul - data));
+            data = nul + 1;
         }
+    }
+
+    void addRecord(const char* record, int length) {
+        const char* space = static_cast<const char*>(memchr(record, ' ', length));
+        if (!space) return;
+        qint64 bytes = 0;
+        for (const char* p = record; p < space; ++p) bytes = bytes * 10 + (*p - '0');
+        tree->add(space + 1, int(record + length - space - 1), bytes);
+        ++entries;
+    }
+};
+
+// Squarified treemap of one directory level; double-clicking a tile
+// activates the node behind it.
+class TreemapWidget : public QWidget {
+    Q_OBJECT
+public:
+    struct Tile {
+        QString label;
+        qint64 size;
+        quint32 node;
+        QRectF rect;
+    };
+
+private:
+    QVector<Tile> tiles;
 
-        ssh_channel_send_eof(channel);
-        ssh_channel_close(channel);
-        ssh_channel_free(channel);
+public:
+    TreemapWidget(QWidget* parent = nullptr) : QWidget(parent) { setMinimumSize(200, 200); }
 
-        return output;
+    // items must be sorted by size, largest first.
+    void setTiles(const QVector<Tile>& items) {
+        tiles.clear();
+        for (const Tile& tile : items)
+            if (tile.size > 0) tiles.append(tile);
+        layoutTiles();
+        update();
     }
 
-    QByteArray getFileBase64(const QString& path) {
-        QByteArray result;
-        if (!session) return result;
+signals:
+    void tileActivated(quint32 node);
 
-        ssh_channel channel = ssh_channel_new(session);
-        if (!channel) return result;
+protected:
+    void resizeEvent(QResizeEvent*) override { layoutTiles(); }
 
-        if (ssh_channel_open_session(channel) != SSH_OK) return result;
-        QString cmd = "base64 \"" + path + "\"";
-        if (ssh_channel_request_exec(channel, cmd.toStdString().c_str()) != SSH_OK) {
-            ssh_channel_close(channel);
-            ssh_channel_free(channel);
-            return result;
+    void paintEvent(QPaintEvent*) override {
+        QPainter painter(this);
+        painter.fillRect(rect(), palette().window());
+        for (const Tile& tile : tiles) {
+            QColor color = QColor::fromHsv(int(qHash(tile.label) % 360), 90, 220);
+            painter.fillRect(tile.rect, color);
+            painter.setPen(palette().windowText().color());
+            painter.drawRect(tile.rect);
+            if (tile.rect.width() > 40 && tile.rect.height() > 16)
+                painter.drawText(tile.rect.adjusted(3, 2, -3, -2), Qt::AlignLeft | Qt::AlignTop | Qt::TextWordWrap,
+                                 tile.label + "\n" + formatSize(tile.size));
         }
+    }
 
-        char buffer[4096];
-        int nbytes;
-        while ((nbytes = ssh_channel_read(channel, buffer, sizeof(buffer), 0)) > 0) {
-            result.append(QByteArray(buffer, nbytes));
+    void mouseDoubleClickEvent(QMouseEvent* event) override {
+        for (const Tile& tile : tiles) {
+            if (tile.rect.contains(event->pos())) {
+                emit tileActivated(tile.node);
+                return;
+            }
         }
+    }
+
+private:
+    static double worst(double rowArea, double largest, double smallest, double side) {
+        double s2 = side * side, r2 = rowArea * rowArea;
+        return qMax(s2 * largest / r2, r2 / (s2 * smallest));
+    }
 
-        ssh_channel_send_eof(channel);
-        ssh_channel_close(channel);
-        ssh_channel_free(channel);
+    void layoutTiles() {
+        QRectF free = rect().adjusted(0, 0, -1, -1);
+        double remaining = 0;
+        for (const Tile& tile : tiles) remaining += tile.size;
 
-        return QByteArray::fromBase64(result);
+        int i = 0;
+        while (i < tiles.size() && free.width() > 0 && free.height() > 0) {
+            double scale = free.width() * free.height() / remaining;
+            double side = qMin(free.width(), free.height());
+
+            // Grow the row while that keeps its tiles closer to square.
+            int j = i;
+            double rowArea = 0, best = 0;
+            while (j < tiles.size()) {
+                double area = tiles[j].size * scale;
+                double score = worst(rowArea + area, tiles[i].size * scale, area, side);
+                if (j > i && score > best) break;
+                best = score;
+                rowArea += area;
+                ++j;
+            }
+
+            bool column = free.width() >= free.height();
+            double thickness = rowArea / side;
+            double offset = 0;
+            for (int k = i; k < j; ++k) {
+                double extent = tiles[k].size * scale / thickness;
+                tiles[k].rect = column ? QRectF(free.left(), free.top() + offset, thickness, extent)
+                                       : QRectF(free.left() + offset, free.top(), extent, thickness);
+                offset += extent;
+                remaining -= tiles[k].size;
+            }
+            if (column) free.setLeft(free.left() + thickness);
+            else free.setTop(free.top() + thickness);
+            i = j;
+        }
     }
+};
 
-    void uploadFileBase64(const QString& localPath, const QString& remotePath) {
-        QFile file(localPath);
-        if (!file.open(QIODevice::ReadOnly)) return;
+// Disk usage of a remote tree: per-directory totals and a treemap that
+// fill in while the scan is still streaming.
+class DiskUsageDialog : public QDialog {
+    Q_OBJECT
+    static const int maxShown = 300;
+
+    DiskUsageTree tree;
+    DiskUsageScan* scan;
+    quint32 focus = 0;
+    QString scanRoot;
+    QElapsedTimer scanClock;
+
+    QLineEdit* rootEdit;
+    QPushButton *scanBtn, *stopBtn, *upBtn;
+    QLabel* status;
+    QTableWidget* totals;
+    TreemapWidget* treemap;
+    QTimer* refreshTimer;
+
+public:
+    DiskUsageDialog(SessionClient* executor, const QString& rootPath, QWidget* parent = nullptr) : QDialog(parent) {
+        setWindowTitle("Disk Usage");
+        resize(1000, 650);
+        scan = new DiskUsageScan(executor, &tree, this);
+
+        QVBoxLayout* layout = new QVBoxLayout(this);
+        QHBoxLayout* controls = new QHBoxLayout;
+        rootEdit = new QLineEdit(rootPath);
+        scanBtn = new QPushButton("Scan");
+        stopBtn = new QPushButton("Stop");
+        upBtn = new QPushButton("Up");
+        stopBtn->setEnabled(false);
+        controls->addWidget(upBtn);
+        controls->addWidget(rootEdit, 1);
+        controls->addWidget(scanBtn);
+        controls->addWidget(stopBtn);
+        layout->addLayout(controls);
+
+        QSplitter* splitter = new QSplitter;
+        totals = new QTableWidget(0, 3);
+        totals->setHorizontalHeaderLabels(QStringList() << "Name" << "Size" << "Files");
+        totals->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+        totals->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        totals->setSelectionBehavior(QAbstractItemView::SelectRows);
+        totals->verticalHeader()->hide();
+        treemap = new TreemapWidget;
+        splitter->addWidget(totals);
+        splitter->addWidget(treemap);
+        splitter->setStretchFactor(1, 1);
+        layout->addWidget(splitter, 1);
+        status = new QLabel;
+        layout->addWidget(status);
 
-        QByteArray base64Data = file.readAll().toBase64();
-        QString echoCmd = QString("echo '%1' | base64 -d > \"%2\"")
-                          .arg(QString::fromUtf8(base64Data))
-                          .arg(remotePath);
-        runCommand(echoCmd);
+        refreshTimer = new QTimer(this);
+        refreshTimer->setInterval(500);
+        connect(refreshTimer, &QTimer::timeout, this, &DiskUsageDialog::refresh);
+
+        connect(scanBtn, &QPushButton::clicked, this, [this]() {
+            scanRoot = rootEdit->text();
+            focus = tree.root();
+            scanClock.start();
+            scanBtn->setEnabled(false);
+            stopBtn->setEnabled(true);
+            scan->start(scanRoot);
+            refreshTimer->start();
+            refresh();
+        });
+        connect(stopBtn, &QPushButton::clicked, this, [this]() {
+            scan->cancel();
+            scanStopped();
+        });
+        connect(scan, &DiskUsageScan::finished, this, &DiskUsageDialog::scanStopped);
+        connect(upBtn, &QPushButton::clicked, this, [this]() {
+            if (focus != tree.root()) focusOn(tree.parent(focus));
+        });
+        connect(totals, &QTableWidget::cellDoubleClicked, this, [this](int row, int) {
+            focusOn(totals->item(row, 0)->data(Qt::UserRole).toUInt());
+        });
+        connect(treemap, &TreemapWidget::tileActivated, this, &DiskUsageDialog::focusOn);
     }
 
-    void renameRemoteFile(const QString& oldPath, const QString& newPath) {
-        QString cmd = QString("mv \"%1\" \"%2\"").arg(oldPath, newPath);
-        runCommand(cmd);
+private:
+    void focusOn(quint32 node) {
+        if (!tree.hasChildren(node)) return;
+        focus = node;
+        refresh();
     }
 
-    void promptRename(QWidget* parent, const QString& oldPath) {
-        bool ok;
-        QString newName = QInputDialog::getText(parent, "Rename File", "New name:", QLineEdit::Normal, QFileInfo(oldPath).fileName(), &ok);
-        if (ok && !newName.isEmpty()) {
-            QString newPath = QFileInfo(oldPath).absolutePath() + "/" + newName;
-            renameRemoteFile(oldPath, newPath);
-        }
+    void scanStopped() {
+        refreshTimer->stop();
+        scanBtn->setEnabled(true);
+        stopBtn->setEnabled(false);
+        refresh();
     }
 
-    void disconnect() {
-        if (session) {
-            ssh_disconnect(session);
-            ssh_free(session);
-            session = nullptr;
+    void refresh() {
+        std::vector<quint32> children = tree.children(focus);
+        int shown = int(qMin<size_t>(children.size(), maxShown));
+        totals->setRowCount(shown);
+        QVector<TreemapWidget::Tile> tiles;
+        for (int row = 0; row < shown; ++row) {
+            quint32 node = children[row];
+            QString label = tree.name(node) + (tree.hasChildren(node) ? "/" : "");
+            QTableWidgetItem* nameItem = new QTableWidgetItem(label);
+            nameItem->setData(Qt::UserRole, node);
+            totals->setItem(row, 0, nameItem);
+            totals->setItem(row, 1, new QTableWidgetItem(formatSize(tree.size(node))));
+            totals->setItem(row, 2, new QTableWidgetItem(QString::number(tree.files(node))));
+            tiles.append(TreemapWidget::Tile{ label, tree.size(node), node, QRectF() });
         }
-    }
+        treemap->setTiles(tiles);
+        upBtn->setEnabled(focus != tree.root());
 
-    ~SSHSession() { disconnect(); }
+        QString where = joinPath(scanRoot, tree.path(focus));
+        status->setText(QString("%1: %2 in %3 files%4 (%5 entries scanned, %6 ms)")
+                            .arg(where, formatSize(tree.size(focus))).arg(tree.files(focus))
+                            .arg(scan->isRunning() ? ", scanning..." : "")
+                            .arg(scan->entryCount()).arg(scanClock.elapsed()));
+    }
 };
 
 class FileBrowserWidget : public QWidget {
     Q_OBJECT
     QListView* listView;
-    QStandardItemModel* model;
-    SSHSession* session;
+    RemoteDirModel* model;
+    QCheckBox* watchBox;
+    QCheckBox* agentBox;
+    ConsoleView* console;
+    QMenu* actionMenu;
+    QPushButton* stopBtn;
+    QMap<QString, QString> quickActions;
+    QList<int> runningActions;
+    SessionClient* executor;
+    DirectoryWatcher* watcher;
+    ListingSnapshotStore* snapshots;
+    ListingCache listingCache;
+    ListingPrefetcher* prefetcher;
+    RemoteAgent* agent;
+    SyncEngine* syncEngine;
+    quint32 agentListing = 0;
+    QTimer* prefetchTimer;
+    QTimer* restatTimer;
+    QSet<QString> staleEntries;
+    // What the snapshot store last held for savedPath, so unchanged refreshes skip the write.
+    QString savedPath;
+    QVector<RemoteEntry> savedEntries;
+    QLineEdit* pathEdit;
+    QPushButton *backBtn, *fwdBtn;
+    QStack<QString> backStack, forwardStack;
+    QString hostKey;
     QString currentPath;
+    int listingRequest = 0;
+    bool firstPaintRecorded = false;
 
 public:
-    FileBrowserWidget(SSHSession* ssh, QWidget* parent = nullptr) : QWidget(parent), session(ssh) {
+    FileBrowserWidget(SessionClient* exec, ListingSnapshotStore* store, const QString& host, QWidget* parent = nullptr)
+        : QWidget(parent), executor(exec), snapshots(store), hostKey(host) {
         QVBoxLayout* layout = new QVBoxLayout(this);
+        QHBoxLayout* topLayout = new QHBoxLayout;
+        backBtn = new QPushButton("<", this);
+        fwdBtn = new QPushButton(">", this);
+        pathEdit = new QLineEdit(this);
+        topLayout->addWidget(backBtn);
+        topLayout->addWidget(fwdBtn);
+        topLayout->addWidget(pathEdit);
+        connect(backBtn, &QPushButton::clicked, this, &FileBrowserWidget::goBack);
+        connect(fwdBtn, &QPushButton::clicked, this, &FileBrowserWidget::goForward);
+        connect(pathEdit, &QLineEdit::returnPressed, this, [this]() { navigateTo(pathEdit->text().trimmed()); });
+
+        watchBox = new QCheckBox("Watch for changes", this);
+        agentBox = new QCheckBox("Use helper", this);
+        agentBox->setToolTip("Install a small shell helper on the host for faster listings, previews and sync");
+        agentBox->setChecked(snapshots->preference("use_agent", false).toBool());
+        QPushButton* actionMenuBtn = new QPushButton("Actions", this);
+        QPushButton* syncBtn = new QPushButton("Sync...", this);
+        QPushButton* searchBtn = new QPushButton("Search...", this);
+        QPushButton* usageBtn = new QPushButton("Disk Usage...", this);
+        stopBtn = new QPushButton("Stop", this);
+        stopBtn->setEnabled(false);
+        topLayout->addWidget(watchBox);
+        topLayout->addWidget(agentBox);
+        topLayout->addWidget(searchBtn);
+        topLayout->addWidget(usageBtn);
+        topLayout->addWidget(syncBtn);
+        topLayout->addWidget(actionMenuBtn);
+        topLayout->addWidget(stopBtn);
+        layout->addLayout(topLayout);
+
+        actionMenu = new QMenu(this);
+        actionMenuBtn->setMenu(actionMenu);
+        actionMenu->addAction("Add Action", this, &FileBrowserWidget::addQuickAction);
+        actionMenu->addAction("Remove Action", this, &FileBrowserWidget::removeQuickAction);
+        actionMenu->addAction("Run on Hosts...", this, [this]() {
+            FanOutDialog* dlg = new FanOutDialog(snapshots, quickActions, this);
+            dlg->setAttribute(Qt::WA_DeleteOnClose);
+            dlg->show();
+        });
+        connect(stopBtn, &QPushButton::clicked, this, &FileBrowserWidget::stopActions);
+
+        watcher = new DirectoryWatcher(executor, this);
+        connect(watchBox, &QCheckBox::toggled, this, [this](bool on) {
+            if (on) watcher->watch(currentPath);
+            else watcher->stop();
+        });
+        connect(watcher, &DirectoryWatcher::entryAdded, this, &FileBrowserWidget::addEntry);
+        connect(watcher, &DirectoryWatcher::entryRemoved, this, &FileBrowserWidget::removeEntry);
+        connect(watcher, &DirectoryWatcher::entryChanged, this, &FileBrowserWidget::updateEntry);
+        // A file being written sends a stream of modify events; they are collected
+        // and re-stat'ed at most every 250 ms, once per name.
+        restatTimer = new QTimer(this);
+        restatTimer->setSingleShot(true);
+        restatTimer->setInterval(250);
+        connect(restatTimer, &QTimer::timeout, this, &FileBrowserWidget::restatEntries);
+        connect(watcher, &DirectoryWatcher::directoryChanged, this, [this]() { refreshDirectory(currentPath); });
+
         listView = new QListView(this);
         listView->setViewMode(QListView::IconMode);
         listView->setIconSize(QSize(64, 64));
         listView->setResizeMode(QListView::Adjust);
         listView->setContextMenuPolicy(Qt::CustomContextMenu);
         connect(listView, &QListView::customContextMenuRequested, this, &FileBrowserWidget::showContextMenu);
+        connect(listView, &QListView::doubleClicked, this, &FileBrowserWidget::enterDirectory);
+
+        // The helper is optional; with it off every operation takes its shell path.
+        agent = new RemoteAgent(executor, this);
+        if (agentBox->isChecked()) agent->start();
+        connect(agentBox, &QCheckBox::toggled, this, [this](bool on) {
+            snapshots->setPreference("use_agent", on);
+            if (on) agent->start();
+            else agent->stop();
+        });
 
-        model = new QStandardItemModel(this);
+        connect(searchBtn, &QPushButton::clicked, this, [this]() {
+            SearchDialog* dlg = new SearchDialog(executor, currentPath, this);
+            dlg->setAttribute(Qt::WA_DeleteOnClose);
+            dlg->show();
+        });
+
+        connect(usageBtn, &QPushButton::clicked, this, [this]() {
+            DiskUsageDialog* dlg = new DiskUsageDialog(executor, currentPath, this);
+            dlg->setAttribute(Qt::WA_DeleteOnClose);
+            dlg->show();
+        });
+
+        syncEngine = new SyncEngine(executor, agent, snapshots, hostKey, this);
+        connect(syncBtn, &QPushButton::clicked, this, [this]() {
+            SyncDialog* dlg = new SyncDialog(syncEngine, currentPath, this);
+            dlg->setAttribute(Qt::WA_DeleteOnClose);
+            dlg->show();
+        });
+
+        listingCache.setMaxCost(256);
+        prefetcher = new ListingPrefetcher(executor, &listingCache, this);
+        prefetchTimer = new QTimer(this);
+        prefetchTimer->setSingleShot(true);
+        prefetchTimer->setInterval(250);
+        connect(prefetchTimer, &QTimer::timeout, this, &FileBrowserWidget::startPrefetch);
+        connect(listView->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() { prefetchTimer->start(); });
+
+        model = new RemoteDirModel(this);
         listView->setModel(model);
-        layout->addWidget(listView);
+        listView->viewport()->installEventFilter(this);
+
+        console = new ConsoleView(this);
+        QSplitter* splitter = new QSplitter(Qt::Vertical, this);
+        splitter->addWidget(listView);
+        splitter->addWidget(console);
+        layout->addWidget(splitter);
 
         setLayout(layout);
         refreshDirectory(".");
     }
 
     void refreshDirectory(const QString& path) {
-        model->clear();
         currentPath = path;
-        QStringList files = session->runCommand("ls -p \"" + path + "\"");
-        QFileIconProvider iconProvider;
+        pathEdit->setText(path);
+        backBtn->setEnabled(!backStack.isEmpty());
+        fwdBtn->setEnabled(!forwardStack.isEmpty());
+        executor->cancel(listingRequest);
+        prefetcher->cancel();
+        // The listing on its way carries fresh metadata for every entry.
+        staleEntries.clear();
+        if (watchBox->isChecked()) watcher->watch(path);
+
+        // Paint the last known listing right away, from the prefetch cache or
+        // the on-disk snapshot; the live one is diffed in when it arrives.
+        QVector<RemoteEntry> snapshot;
+        if (path != model->path()) {
+            if (CachedListing* cached = listingCache.object(path))
+                model->setEntries(path, cached->entries);
+            else if (snapshots->load(hostKey, path, snapshot)) {
+                model->setEntries(path, snapshot);
+                savedPath = path;
+                savedEntries = snapshot;
+            }
+        }
+
+        agent->forget(agentListing);
+        agentListing = agent->request("list", QStringList() << path, QByteArray(), [this, path](int status, const QByteArray& payload) {
+            agentListing = 0;
+            if (path != currentPath) return;
+            if (status == 0) applyListing(path, parseListing(payload));
+            else listViaShell(path);
+        });
+        if (!agentListing) listViaShell(path);
+    }
+
+    void listViaShell(const QString& path) {
+        QSharedPointer<QByteArray> listing(new QByteArray);
+        listingRequest = executor->execute(listingCommand(path),
+            [listing](const QByteArray& data) { listing->append(data); },
+            [this, path, listing](int status) {
+                listingRequest = 0;
+                if (status != -1) applyListing(path, parseListing(*listing));
+            });
+    }
+
+    void applyListing(const QString& path, const QVector<RemoteEntry>& entries) {
+        model->setEntries(path, entries);
+        // A polled refresh of an unchanged directory costs only this compare.
+        if (path != savedPath || !sameListing(entries, savedEntries)) {
+            snapshots->save(hostKey, path, entries);
+            savedPath = path;
+            savedEntries = entries;
+        }
+
+        CachedListing* cached = new CachedListing;
+        cached->entries = entries;
+        cached->fetched = QDateTime::currentMSecsSinceEpoch();
+        listingCache.insert(path, cached);
+        prefetchTimer->start();
+    }
+
+    void navigateTo(const QString& path) {
+        if (path.isEmpty() || path == currentPath) return;
+        backStack.push(currentPath);
+        forwardStack.clear();
+        refreshDirectory(path);
+    }
+
+    void goBack() {
+        if (backStack.isEmpty()) return;
+        forwardStack.push(currentPath);
+        refreshDirectory(backStack.pop());
+    }
+
+    void goForward() {
+        if (forwardStack.isEmpty()) return;
+        backStack.push(currentPath);
+        refreshDirectory(forwardStack.pop());
+    }
+
+    void enterDirectory(const QModelIndex& index) {
+        QString name = index.data(Qt::DisplayRole).toString();
+        if (name.endsWith('/')) navigateTo(joinPath(currentPath, name));
+    }
 
-        for (const QString& file : files) {
-            if (file.trimmed().isEmpty()) continue;
-            QStandardItem* item = new QStandardItem(iconProvider.icon(QFileInfo(file)), file);
-            item->setData(path + "/" + file, Qt::UserRole);
-            model->appendRow(item);
+    // Likely next hops first (where back/forward would go), then the folders
+    // currently on screen in view order.
+    void startPrefetch() {
+        QStringList candidates;
+        if (!forwardStack.isEmpty()) candidates << forwardStack.top();
+        if (!backStack.isEmpty()) candidates << backStack.top();
+
+        QRect visible = listView->viewport()->rect();
+        for (int row = 0; row < model->rowCount(); ++row) {
+            QModelIndex index = model->index(row);
+            QString name = index.data(Qt::DisplayRole).toString();
+            if (name.endsWith('/') && listView->visualRect(index).intersects(visible))
+                candidates << joinPath(currentPath, name);
+        }
+        prefetcher->prefetch(candidates);
+    }
+
+    bool eventFilter(QObject* obj, QEvent* event) override {
+        if (!firstPaintRecorded && event->type() == QEvent::Paint && model->rowCount() > 0) {
+            firstPaintRecorded = true;
+            snapshots->recordMetric("startup.first_paint_ms", startupTimer.elapsed());
+        }
+        return QWidget::eventFilter(obj, event);
+    }
+
+    void addEntry(const QString& name, bool isDir) {
+        RemoteEntry entry;
+        entry.name = isDir ? name + "/" : name;
+        entry.isDir = isDir;
+        model->insertEntry(entry);
+        // The event carries no size or mtime; fetch them like a modify.
+        updateEntry(entry.name);
+    }
+
+    void removeEntry(const QString& name) {
+        model->removeEntry(name);
+    }
+
+    // Marks an entry for re-stat after a modify or attribute event.
+    void updateEntry(const QString& name) {
+        staleEntries.insert(name);
+        if (!restatTimer->isActive()) restatTimer->start();
+    }
+
+    void restatEntries() {
+        QSet<QString> names;
+        names.swap(staleEntries);
+        for (const QString& name : names)
+            if (model->rowForName(name) != -1) restatEntry(name);
+    }
+
+    void restatEntry(const QString& name) {
+        QString dir = currentPath;
+        QString path = joinPath(dir, name);
+        auto apply = [this, dir](const QByteArray& output) {
+            if (dir != currentPath) return;
+            QVector<RemoteEntry> stat = parseListing(output);
+            if (stat.size() == 1 && stat[0].size >= 0) model->updateEntry(stat[0]);
+        };
+        if (agent->request("stat", QStringList() << path, QByteArray(), [this, path, apply](int status, const QByteArray& payload) {
+                if (status == 0) apply(payload);
+                else if (status == -1) statViaShell(path, apply);
+            }))
+            return;
+        statViaShell(path, apply);
+    }
+
+    void statViaShell(const QString& path, std::function<void(const QByteArray&)> apply) {
+        QSharedPointer<QByteArray> output(new QByteArray);
+        executor->execute(QString("find %1 -maxdepth 0 -printf '%y\\t%s\\t%T@\\t%f\\n' 2>/dev/null").arg(shellQuote(path)),
+            [output](const QByteArray& data) { output->append(data); },
+            [output, apply](int status) {
+                if (status == 0) apply(*output);
+            });
+    }
+
+    void addQuickAction() {
+        QString name = QInputDialog::getText(this, "Action Name", "Enter Action Name:");
+        QString command = QInputDialog::getText(this, "SSH Command", "Command to execute:");
+        if (name.isEmpty() || command.isEmpty()) return;
+
+        QAction* act = new QAction(name, this);
+        connect(act, &QAction::triggered, this, [this, command]() { runQuickAction(command); });
+
+        quickActions[name] = command;
+        actionMenu->addAction(act);
+    }
+
+    void removeQuickAction() {
+        QString name = QInputDialog::getText(this, "Remove Action", "Name of Action:");
+        for (QAction* act : actionMenu->actions()) {
+            if (act->text() == name && quickActions.contains(name)) {
+                actionMenu->removeAction(act);
+                quickActions.remove(name);
+                delete act;
+                break;
+            }
         }
     }
 
+    void runQuickAction(const QString& command) {
+        console->appendLine("$ " + command);
+        QSharedPointer<int> id(new int(0));
+        *id = executor->execute(command,
+            [this](const QByteArray& data) { console->appendOutput(data); },
+            [this, id](int status) {
+                console->flush(true);
+                if (status != 0) console->appendLine(QString("[exit %1]").arg(status));
+                runningActions.removeAll(*id);
+                stopBtn->setEnabled(!runningActions.isEmpty());
+            });
+        runningActions.append(*id);
+        stopBtn->setEnabled(true);
+    }
+
+    void stopActions() {
+        for (int id : runningActions) executor->cancel(id);
+        runningActions.clear();
+        stopBtn->setEnabled(false);
+        console->appendLine("[cancelled]");
+    }
+
+    void showPreview(const QString& filePath, qint64 knownSize = -1) {
+        // The agent returns raw bytes, so there is nothing to decode. The listing size
+        // may be stale, so it only sizes the shell path's buffer; reads always run to EOF.
+        quint32 viaAgent = agent->request("read", QStringList() << filePath << "0" << "-",
+            QByteArray(), [this, filePath, knownSize](int status, const QByteArray& payload) {
+                if (status == 0) openPreview(payload);
+                else if (status == -1) previewViaShell(filePath, knownSize);
+            });
+        if (!viaAgent) previewViaShell(filePath, knownSize);
+    }
+
+    void previewViaShell(const QString& filePath, qint64 knownSize) {
+        QSharedPointer<QByteArray> decoded(new QByteArray);
+        QSharedPointer<Base64Decoder> decoder(new Base64Decoder);
+        if (knownSize >= 0) decoded->reserve(int(knownSize) + 32);
+        executor->execute("base64 " + shellQuote(filePath),
+            [decoded, decoder](const QByteArray& data) { decoder->decode(data, *decoded); },
+            [this, decoded, decoder](int) {
+                decoder->finish();
+                openPreview(*decoded);
+            });
+    }
+
+    void openPreview(const QByteArray& data) {
+        QDialog* dlg = new QDialog(this);
+        dlg->setAttribute(Qt::WA_DeleteOnClose);
+        QVBoxLayout* vbox = new QVBoxLayout(dlg);
+        QLabel* label = new QLabel(dlg);
+        label->setPixmap(QPixmap::fromImage(QImage::fromData(data)).scaled(500, 500, Qt::KeepAspectRatio));
+        vbox->addWidget(label);
+        dlg->show();
+    }
+
+    void promptRename(const QString& oldPath) {
+        bool ok;
+        QString newName = QInputDialog::getText(this, "Rename File", "New name:", QLineEdit::Normal, QFileInfo(oldPath).fileName(), &ok);
+        if (!ok || newName.isEmpty()) return;
+
+        QString newPath = QFileInfo(oldPath).absolutePath() + "/" + newName;
+        if (agent->request("rename", QStringList() << oldPath << newPath, QByteArray(),
+                           [this](int, const QByteArray&) { refreshDirectory(currentPath); }))
+            return;
+        executor->execute(QString("mv %1 %2").arg(shellQuote(oldPath), shellQuote(newPath)), SSHCommandExecutor::OutputHandler(),
+                          [this](int) { refreshDirectory(currentPath); });
+    }
+
     void showContextMenu(const QPoint& pos) {
         QModelIndex index = listView->indexAt(pos);
         if (!index.isValid()) return;
 
-        QString filePath = model->itemFromIndex(index)->data(Qt::UserRole).toString();
+        QString filePath = index.data(Qt::UserRole).toString();
 
         QMenu menu;
         QAction* renameAct = menu.addAction("Rename");
@@ -180,34 +3678,340 @@ public:
         QAction* selected = menu.exec(listView->viewport()->mapToGlobal(pos));
 
         if (selected == renameAct) {
-            session->promptRename(this, filePath);
-            refreshDirectory(currentPath);
+            promptRename(filePath);
         } else if (selected == previewAct) {
-            QByteArray data = session->getFileBase64(filePath);
-            QDialog* dlg = new QDialog(this);
-            QVBoxLayout* vbox = new QVBoxLayout(dlg);
-            QLabel* label = new QLabel(dlg);
-            label->setPixmap(QPixmap::fromImage(QImage::fromData(data)).scaled(500, 500, Qt::KeepAspectRatio));
-            vbox->addWidget(label);
-            dlg->exec();
+            showPreview(filePath, index.data(Qt::UserRole + 1).toLongLong());
+        }
+    }
+};
+
+// One tab per open connection. Every tab has its own SessionClient and
+// therefore its own session thread, so tabs never wait on each other.
+class BrowserWindow : public QMainWindow {
+    Q_OBJECT
+    ListingSnapshotStore* store;
+    QTabWidget* tabs;
+    QMap<QWidget*, SessionClient*> sessions;
+
+public:
+    BrowserWindow(ListingSnapshotStore* snapshots, QWidget* parent = nullptr) : QMainWindow(parent), store(snapshots) {
+        tabs = new QTabWidget(this);
+        tabs->setTabsClosable(true);
+        tabs->setDocumentMode(true);
+        QPushButton* newTabBtn = new QPushButton("+", tabs);
+        tabs->setCornerWidget(newTabBtn);
+        setCentralWidget(tabs);
+
+        connect(newTabBtn, &QPushButton::clicked, this, &BrowserWindow::chooseConnection);
+        connect(tabs, &QTabWidget::tabCloseRequested, this, [this](int index) { closeTab(tabs->widget(index)); });
+    }
+
+    ~BrowserWindow() {
+        while (tabs->count() > 0) closeTab(tabs->widget(0));
+    }
+
+    void openTab(const SavedConnection& connection) {
+        SessionClient* client = new SessionClient(connection.key());
+        TransferTuning tuning;
+        if (store->loadTuning(connection.key(), tuning)) client->setTuning(tuning);
+        FileBrowserWidget* browser = new FileBrowserWidget(client, store, connection.key());
+        sessions.insert(browser, client);
+        tabs->setCurrentIndex(tabs->addTab(browser, connection.key()));
+
+        connect(client, &SessionClient::connectionFailed, this, [this, browser, connection](const QString& error) {
+            QMessageBox::critical(this, "SSH Error", "Failed to connect to " + connection.key() + ": " + error);
+            closeTab(browser);
+            if (tabs->count() == 0) QApplication::exit(-1);
+        });
+        client->connectToHost(connection.host, connection.user, connection.password);
+    }
+
+private:
+    void chooseConnection() {
+        QList<SavedConnection> connections = store->savedConnections();
+        QStringList keys;
+        for (const SavedConnection& connection : connections) keys << connection.key();
+        bool ok;
+        QString key = QInputDialog::getItem(this, "New Tab", "Connection:", keys, 0, false, &ok);
+        if (!ok) return;
+        openTab(connections[keys.indexOf(key)]);
+    }
+
+    // The widget goes first: its helpers still cancel their commands on the client.
+    void closeTab(QWidget* browser) {
+        if (!sessions.contains(browser)) return;
+        tabs->removeTab(tabs->indexOf(browser));
+        delete browser;
+        SessionClient* client = sessions.take(browser);
+        store->saveTuning(client->objectName(), client->tuning());
+        delete client;
+    }
+};
+
+// Headless front end over the same sessions, snapshot store and sync engine
+// the browser uses. Runs one command and prints a single JSON object with
+// its result and timings to stdout.
+class BatchRunner : public QObject {
+    Q_OBJECT
+    SessionClient* client;
+    ListingSnapshotStore* store;
+    QString hostKey;
+    QString command;
+    QStringList args;
+    SyncEngine::Options syncOptions;
+    QElapsedTimer clock;
+    qint64 connectMs = -1;
+    qint64 bytes = 0;
+    QJsonObject result;
+
+    // put: the file is read only as far as uploadWindow ahead of what the channel has sent.
+    static const int uploadChunk = 1024 * 1024;
+    static const qint64 uploadWindow = 4 * uploadChunk;
+    QFile upload;
+    int uploadId = 0;
+    qint64 uploadQueued = 0;
+
+public:
+    BatchRunner(SessionClient* session, ListingSnapshotStore* snapshots, const QString& host, const QString& cmd,
+                const QStringList& arguments, const SyncEngine::Options& sync, QObject* parent = nullptr)
+        : QObject(parent), client(session), store(snapshots), hostKey(host), command(cmd), args(arguments), syncOptions(sync) {}
+
+    // Commands queue on the client until it is connected, so they are issued right away.
+    void start() {
+        clock.start();
+        connect(client, &SessionClient::connected, this, [this]() { connectMs = clock.elapsed(); });
+        connect(client, &SessionClient::connectionFailed, this, [this](const QString& error) { fail("connection failed: " + error); });
+
+        if (command == "ls" && args.size() == 1) list(args[0]);
+        else if (command == "get" && args.size() == 2) get(args[0], args[1]);
+        else if (command == "put" && args.size() == 2) put(args[0], args[1]);
+        else if (command == "sync" && args.size() == 2) sync(args[0], args[1]);
+        else if (command == "exec" && !args.isEmpty()) exec(args.join(' '));
+        else fail("usage: ls PATH | get REMOTE LOCAL | put LOCAL REMOTE | sync LOCAL_DIR REMOTE_DIR | exec COMMAND...");
+    }
+
+private:
+    void list(const QString& path) {
+        QSharedPointer<QByteArray> output(new QByteArray);
+        client->execute(listingCommand(path),
+            [output](const QByteArray& data) { output->append(data); },
+            [this, path, output](int status) {
+                if (status != 0) return fail(QString("listing failed with status %1").arg(status));
+                QVector<RemoteEntry> entries = parseListing(*output);
+                store->save(hostKey, path, entries);
+                QJsonArray items;
+                for (const RemoteEntry& entry : entries) {
+                    QJsonObject item;
+                    item["name"] = entry.isDir ? entry.name.left(entry.name.size() - 1) : entry.name;
+                    item["dir"] = entry.isDir;
+                    item["size"] = double(entry.size);
+                    item["mtime_ms"] = double(entry.mtime);
+                    items.append(item);
+                }
+                result["entries"] = items;
+                bytes = output->size();
+                finish(true);
+            });
+    }
+
+    void get(const QString& remotePath, const QString& localPath) {
+        QSharedPointer<QFile> file(new QFile(localPath));
+        if (!file->open(QIODevice::WriteOnly)) return fail("cannot write " + localPath);
+        QSharedPointer<bool> writeFailed(new bool(false));
+        client->execute("cat -- " + shellQuote(remotePath),
+            [this, file, writeFailed](const QByteArray& data) {
+                if (file->write(data) != data.size()) *writeFailed = true;
+                bytes += data.size();
+            },
+            [this, file, writeFailed](int status) {
+                file->close();
+                if (*writeFailed) return fail("write error on " + file->fileName());
+                if (status != 0) return fail(QString("remote read failed with status %1").arg(status));
+                client->recordTransfer(bytes, clock.elapsed() - qMax<qint64>(connectMs, 0));
+                finish(true);
+            });
+    }
+
+    void put(const QString& localPath, const QString& remotePath) {
+        upload.setFileName(localPath);
+        if (!upload.open(QIODevice::ReadOnly)) return fail("cannot read " + localPath);
+        uploadId = client->execute("cat > " + shellQuote(remotePath), SessionClient::OutputHandler(), [this](int status) {
+            if (status != 0) return fail(QString("remote write failed with status %1").arg(status));
+            client->recordTransfer(bytes, clock.elapsed() - qMax<qint64>(connectMs, 0));
+            finish(true);
+        });
+        // Bytes count once they are on the wire, not when they are queued.
+        connect(client, &SessionClient::inputWritten, this, [this](int id, qint64 sent) {
+            if (id != uploadId) return;
+            bytes += sent;
+            feedUpload();
+        });
+        feedUpload();
+    }
+
+    void feedUpload() {
+        while (upload.isOpen() && uploadQueued - bytes < uploadWindow) {
+            QByteArray chunk = upload.read(uploadChunk);
+            if (chunk.isEmpty()) {
+                bool readError = !upload.atEnd();
+                upload.close();
+                if (readError) {
+                    client->cancel(uploadId);
+                    return fail("read error on " + upload.fileName());
+                }
+                client->closeInput(uploadId);
+                return;
+            }
+            client->write(uploadId, chunk);
+            uploadQueued += chunk.size();
         }
     }
+
+    void exec(const QString& cmd) {
+        QSharedPointer<QByteArray> output(new QByteArray);
+        client->execute(cmd,
+            [output](const QByteArray& data) { output->append(data); },
+            [this, output](int status) {
+                result["exit"] = status;
+                result["stdout"] = QString::fromUtf8(*output);
+                bytes = output->size();
+                finish(status == 0);
+            });
+    }
+
+    void sync(const QString& localRoot, const QString& remoteRoot) {
+        RemoteAgent* agent = new RemoteAgent(client, this);
+        if (store->preference("use_agent", false).toBool()) agent->start();
+        SyncEngine* engine = new SyncEngine(client, agent, store, hostKey, this);
+        connect(engine, &SyncEngine::planReady, this, [this, engine]() {
+            QJsonArray plan;
+            for (const SyncAction& action : engine->currentPlan()) plan.append(SyncEngine::describe(action).simplified());
+            result["plan"] = plan;
+            if (!syncOptions.dryRun) engine->execute();
+        });
+        connect(engine, &SyncEngine::finished, this, [this](bool ok, const QString& summary) {
+            result["summary"] = summary;
+            finish(ok);
+        });
+        syncOptions.localRoot = localRoot;
+        syncOptions.remoteRoot = remoteRoot;
+        engine->start(syncOptions);
+    }
+
+    void fail(const QString& error) {
+        result["error"] = error;
+        finish(false);
+    }
+
+    void finish(bool ok) {
+        if (result.contains("ok")) return;
+        qint64 total = clock.elapsed();
+        qint64 work = total - qMax<qint64>(connectMs, 0);
+        result["ok"] = ok;
+        result["command"] = command;
+        result["host"] = hostKey;
+        result["connect_ms"] = double(connectMs);
+        result["total_ms"] = double(total);
+        result["bytes"] = double(bytes);
+        if (work > 0) result["mib_per_s"] = bytes / 1048576.0 / (work / 1000.0);
+
+        const TransferTuning& tuning = client->tuning();
+        QJsonObject tuned;
+        tuned["chunk_size"] = tuning.chunkSize;
+        tuned["in_flight"] = tuning.inFlight;
+        tuned["compression"] = tuning.compression;
+        tuned["rtt_ms"] = tuning.rttMs;
+        result["tuning"] = tuned;
+        store->saveTuning(hostKey, tuning);
+
+        QByteArray json = QJsonDocument(result).toJson(QJsonDocument::Compact);
+        fwrite(json.constData(), 1, json.size(), stdout);
+        fputc('\n', stdout);
+        fflush(stdout);
+        // Usage errors finish before the event loop runs, where exit() alone would be lost.
+        QTimer::singleShot(0, qApp, [ok]() { QCoreApplication::exit(ok ? 0 : 1); });
+    }
 };
 
+// sshBrowser --batch [--password P] [--dry-run] [--hashes] [--full] user@host COMMAND ARGS...
+static int runBatch(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs one command headless and prints the result as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption batchOption("batch", "Run without a GUI.");
+    QCommandLineOption passwordOption("password", "Password; defaults to $SSHBROWSER_PASSWORD, then the saved connection.", "password");
+    QCommandLineOption dryRunOption("dry-run", "sync: print the plan without changing anything.");
+    QCommandLineOption hashesOption("hashes", "sync: compare SHA-256 hashes, not just size and mtime.");
+    QCommandLineOption fullOption("full", "sync: ignore hashes recorded by the previous run.");
+    parser.addOption(batchOption);
+    parser.addOption(passwordOption);
+    parser.addOption(dryRunOption);
+    parser.addOption(hashesOption);
+    parser.addOption(fullOption);
+    parser.addPositionalArgument("target", "user@host");
+    parser.addPositionalArgument("command", "ls, get, put, sync or exec");
+    parser.addPositionalArgument("args", "Arguments of the command.", "[args...]");
+    // Everything after user@host belongs to the command, so "exec ls -la" keeps its -la.
+    parser.setOptionsAfterPositionalArgumentsMode(QCommandLineParser::ParseAsPositionalArguments);
+    parser.process(app);
+
+    QStringList positional = parser.positionalArguments();
+    int at = positional.isEmpty() ? -1 : positional[0].indexOf('@');
+    if (positional.size() < 2 || at <= 0) parser.showHelp(1);
+
+    SavedConnection connection;
+    connection.user = positional[0].left(at);
+    connection.host = positional[0].mid(at + 1);
+
+    ListingSnapshotStore snapshots;
+    snapshots.open();
+    if (parser.isSet(passwordOption)) {
+        connection.password = parser.value(passwordOption);
+    } else if (qEnvironmentVariableIsSet("SSHBROWSER_PASSWORD")) {
+        connection.password = QString::fromLocal8Bit(qgetenv("SSHBROWSER_PASSWORD"));
+    } else {
+        for (const SavedConnection& saved : snapshots.savedConnections())
+            if (saved.key() == connection.key()) connection.password = saved.password;
+    }
+
+    SyncEngine::Options syncOptions;
+    syncOptions.dryRun = parser.isSet(dryRunOption);
+    syncOptions.withHashes = parser.isSet(hashesOption);
+    syncOptions.incremental = !parser.isSet(fullOption);
+
+    SessionClient client(connection.key());
+    TransferTuning tuning;
+    if (snapshots.loadTuning(connection.key(), tuning)) client.setTuning(tuning);
+    BatchRunner runner(&client, &snapshots, connection.key(), positional[1], positional.mid(2), syncOptions);
+    client.connectToHost(connection.host, connection.user, connection.password);
+    runner.start();
+    return app.exec();
+}
+
 int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i)
+        if (strcmp(argv[i], "--batch") == 0) return runBatch(argc, argv);
+
+    startupTimer.start();
     QApplication app(argc, argv);
 
-    SSHSession* ssh = new SSHSession();
-    if (!ssh->connectToHost("your.server.com", "user", "password")) {
-        QMessageBox::critical(nullptr, "SSH Error", "Failed to connect.");
-        return -1;
-    }
+    const QString host = "your.server.com", user = "user", password = "password";
+    ListingSnapshotStore snapshots;
+    snapshots.open();
+    snapshots.saveConnection(host, user, password);
+
+    if (qEnvironmentVariableIsSet("SSHBROWSER_FRAME_PROBE")) new FrameLatencyProbe(&snapshots, &app);
+
+    SavedConnection connection;
+    connection.host = host;
+    connection.user = user;
+    connection.password = password;
 
-    QMainWindow window;
-    FileBrowserWidget* browser = new FileBrowserWidget(ssh);
-    window.setCentralWidget(browser);
+    BrowserWindow window(&snapshots);
     window.resize(800, 600);
     window.show();
+    window.openTab(connection);
 
     return app.exec();
 }
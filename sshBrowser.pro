@@ -1,4 +1,4 @@
-QT       += core gui sql network
+QT       += core gui sql network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -19,6 +19,8 @@ SOURCES += \
     main.cpp
 
 HEADERS += \
+    base64codec.h \
+    transfertuning.h
 
 FORMS += \
 
@@ -0,0 +1,14 @@
+QT       += testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_base64
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_base64.cpp
+
+HEADERS += \
+    ../../base64codec.h
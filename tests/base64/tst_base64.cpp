@@ -0,0 +1,144 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "base64codec.h"
+
+// Checks the streaming decoder byte for byte against QByteArray::fromBase64,
+// and every SIMD kernel the CPU supports against the scalar one; the
+// benchmarks time each kernel on the same input.
+class Base64Test : public QObject {
+    Q_OBJECT
+    typedef QPair<const char*, Base64DecodeKernel> NamedKernel;
+
+    QRandomGenerator random{42};
+
+    int below(int n) { return n > 0 ? int(random.bounded(n)) : 0; }
+
+    QByteArray randomBytes(int n) {
+        QByteArray bytes(n, Qt::Uninitialized);
+        for (int i = 0; i < n; ++i) bytes[i] = char(random.bounded(256));
+        return bytes;
+    }
+
+    static QList<NamedKernel> simdKernels() {
+        QList<NamedKernel> kernels;
+#ifdef SSHBROWSER_BASE64_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3")) kernels << NamedKernel("sse4.1", &base64DecodeSse41);
+        if (__builtin_cpu_supports("avx2")) kernels << NamedKernel("avx2", &base64DecodeAvx2);
+#endif
+        return kernels;
+    }
+
+    static QByteArray wrap(const QByteArray& text, int width, const char* lineEnd) {
+        QByteArray wrapped;
+        for (int i = 0; i < text.size(); i += width) wrapped += text.mid(i, width) + lineEnd;
+        return wrapped;
+    }
+
+    // Feeds input in chunks of random size, split anywhere.
+    QByteArray decodeInChunks(const QByteArray& input) {
+        Base64Decoder decoder;
+        QByteArray out;
+        int pos = 0;
+        while (pos < input.size()) {
+            int n = qMin(input.size() - pos, below(200));
+            decoder.decode(input.constData() + pos, n, out);
+            pos += n;
+        }
+        decoder.finish();
+        return out;
+    }
+
+private slots:
+    void roundTrip() {
+        for (int round = 0; round < 3000; ++round) {
+            QByteArray original = randomBytes(below(700));
+            QByteArray encoded = original.toBase64();
+            QByteArray input = round % 3 == 0 ? encoded : wrap(encoded, 76, round % 3 == 1 ? "\n" : "\r\n");
+            QCOMPARE(decodeInChunks(input), original);
+        }
+    }
+
+    void matchesFromBase64OnNoise() {
+        static const char noise[] = "AZaz09+/=\n\r *!-_";
+        for (int round = 0; round < 3000; ++round) {
+            QByteArray input = randomBytes(below(300)).toBase64();
+            for (int i = below(8); i > 0 && !input.isEmpty(); --i)
+                input.insert(below(input.size()), noise[below(int(sizeof(noise)) - 1)]);
+            QCOMPARE(decodeInChunks(input), QByteArray::fromBase64(input));
+        }
+    }
+
+    void largeInput() {
+        QByteArray original = randomBytes(4 * 1024 * 1024 + 7);
+        QByteArray input = wrap(original.toBase64(), 76, "\n");
+        Base64Decoder decoder;
+        QByteArray out;
+        decoder.decode(input, out);
+        decoder.finish();
+        QCOMPARE(out, original);
+    }
+
+    void kernelsMatchScalar() {
+        QList<NamedKernel> kernels = simdKernels();
+        if (kernels.isEmpty()) QSKIP("no SIMD kernel available on this CPU");
+
+        for (int round = 0; round < 2000; ++round) {
+            QByteArray input = randomBytes(below(600)).toBase64();
+            // A stray character stops the bulk kernels at its group.
+            if (round % 4 == 0 && !input.isEmpty()) input[below(input.size())] = '*';
+
+            QByteArray expected(input.size() + 32, 0);
+            size_t expectedWritten;
+            size_t expectedUsed = base64DecodeScalar(input.constData(), input.size(),
+                                                     reinterpret_cast<uchar*>(expected.data()), &expectedWritten);
+            expected.truncate(int(expectedWritten));
+
+            for (const auto& kernel : kernels) {
+                QByteArray out(input.size() + 32, 0);
+                size_t written;
+                size_t used = kernel.second(input.constData(), input.size(), reinterpret_cast<uchar*>(out.data()), &written);
+                out.truncate(int(written));
+                QVERIFY2(used == expectedUsed, kernel.first);
+                QVERIFY2(out == expected, kernel.first);
+            }
+        }
+    }
+
+    // 12 MiB of output per iteration, a multiple of 3 so there is no padding;
+    // divide it by the reported time for GB/s.
+    void kernelBenchmark_data() {
+        QTest::addColumn<int>("kernel");
+        QTest::newRow("scalar") << -1;
+        QList<NamedKernel> kernels = simdKernels();
+        for (int i = 0; i < kernels.size(); ++i) QTest::newRow(kernels[i].first) << i;
+    }
+
+    void kernelBenchmark() {
+        QFETCH(int, kernel);
+        Base64DecodeKernel decode = kernel < 0 ? &base64DecodeScalar : simdKernels()[kernel].second;
+        QByteArray input = randomBytes(12 * 1024 * 1024).toBase64();
+        QByteArray out(input.size() + 32, Qt::Uninitialized);
+        size_t written = 0;
+        QBENCHMARK {
+            decode(input.constData(), input.size(), reinterpret_cast<uchar*>(out.data()), &written);
+        }
+        QCOMPARE(int(written), 12 * 1024 * 1024);
+    }
+
+    void decoderBenchmark() {
+        QByteArray input = wrap(randomBytes(12 * 1024 * 1024).toBase64(), 76, "\n");
+        QByteArray out;
+        out.reserve(12 * 1024 * 1024 + 8);
+        QBENCHMARK {
+            out.resize(0);  // keeps the reserved capacity, unlike clear()
+            Base64Decoder decoder;
+            decoder.decode(input, out);
+            decoder.finish();
+        }
+        QCOMPARE(out.size(), 12 * 1024 * 1024);
+    }
+};
+
+QTEST_APPLESS_MAIN(Base64Test)
+#include "tst_base64.moc"
@@ -0,0 +1,79 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include "transfertuning.h"
+
+// Feeds TransferTuning::record sample sequences shaped like real links and
+// checks where chunk size, window, compression and the throughput estimate
+// settle.
+class TuningTest : public QObject {
+    Q_OBJECT
+
+    // One sample of bytes moved at bytesPerSecond, give or take jitter.
+    static void feed(TransferTuning& tuning, QRandomGenerator& random, int samples, qint64 bytes,
+                     double bytesPerSecond, double jitter) {
+        for (int i = 0; i < samples; ++i) {
+            double rate = bytesPerSecond * (1 + jitter * (2 * random.generateDouble() - 1));
+            tuning.record(bytes, qMax<qint64>(1, qint64(bytes * 1000.0 / rate)));
+        }
+    }
+
+private slots:
+    void lanGrowsToTheLimits() {
+        QRandomGenerator random(1);
+        TransferTuning tuning;
+        tuning.rttMs = 0.4;
+        feed(tuning, random, 60, 8 * 1024 * 1024, 110e6, 0.02);
+        QCOMPARE(tuning.chunkSize, int(TransferTuning::maxChunkSize));
+        QCOMPARE(tuning.inFlight, int(TransferTuning::maxInFlight));
+        QVERIFY(!tuning.compression);
+        QVERIFY(qAbs(tuning.bytesPerSecond - 110e6) < 110e6 * 0.05);
+    }
+
+    void highLatencyLinkTurnsCompressionOn() {
+        QRandomGenerator random(2);
+        TransferTuning tuning;
+        tuning.rttMs = 250;
+        feed(tuning, random, 40, 1024 * 1024, 400e3, 0.02);
+        QVERIFY(tuning.compression);
+        QVERIFY(qAbs(tuning.bytesPerSecond - 400e3) < 400e3 * 0.05);
+        QVERIFY(tuning.inFlight > 8);
+    }
+
+    void sharpDropHalvesThenRecovers() {
+        QRandomGenerator random(3);
+        TransferTuning tuning;
+        feed(tuning, random, 60, 8 * 1024 * 1024, 50e6, 0.02);
+        int chunk = tuning.chunkSize, window = tuning.inFlight;
+
+        tuning.record(8 * 1024 * 1024, qint64(8 * 1024 * 1024 * 1000.0 / 10e6));
+        QCOMPARE(tuning.chunkSize, chunk / 2);
+        QCOMPARE(tuning.inFlight, window / 2);
+
+        feed(tuning, random, 40, 8 * 1024 * 1024, 50e6, 0.02);
+        QCOMPARE(tuning.chunkSize, chunk);
+        QCOMPARE(tuning.inFlight, window);
+    }
+
+    void noisyLinkStaysInBounds() {
+        QRandomGenerator random(4);
+        TransferTuning tuning;
+        tuning.rttMs = 80;
+        for (int i = 0; i < 2000; ++i) {
+            double rate = 1e5 + random.generateDouble() * 5e7;
+            tuning.record(1024 * 1024, qMax<qint64>(1, qint64(1024 * 1024 * 1000.0 / rate)));
+            QVERIFY(tuning.chunkSize >= TransferTuning::minChunkSize && tuning.chunkSize <= TransferTuning::maxChunkSize);
+            QVERIFY(tuning.inFlight >= 1 && tuning.inFlight <= TransferTuning::maxInFlight);
+        }
+    }
+
+    void smallSamplesAreIgnored() {
+        TransferTuning tuning;
+        QVERIFY(!tuning.record(TransferTuning::minSampleBytes - 1, 10));
+        QVERIFY(!tuning.record(TransferTuning::minSampleBytes, 0));
+        QCOMPARE(tuning.bytesPerSecond, 0.0);
+        QCOMPARE(tuning.chunkSize, TransferTuning().chunkSize);
+    }
+};
+
+QTEST_APPLESS_MAIN(TuningTest)
+#include "tst_tuning.moc"
@@ -0,0 +1,14 @@
+QT       += testlib
+QT       -= gui
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_tuning
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_tuning.cpp
+
+HEADERS += \
+    ../../transfertuning.h
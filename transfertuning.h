@@ -0,0 +1,46 @@
+#ifndef TRANSFERTUNING_H
+#define TRANSFERTUNING_H
+
+#include <QtGlobal>
+
+// Transfer parameters for one host, adapted from what its transfers achieve.
+struct TransferTuning {
+    static const int minChunkSize = 16 * 1024;
+    static const int maxChunkSize = 1024 * 1024;
+    static const int chunkStep = 32 * 1024;
+    static const int maxInFlight = 32;
+    static const qint64 minSampleBytes = 256 * 1024;
+
+    int chunkSize = 64 * 1024;    // bytes per channel read
+    int inFlight = 8;             // channels or blocks kept in flight per transfer
+    bool compression = false;     // applied from the next connection
+    double rttMs = -1;            // smoothed round trip of a no-op command
+    double bytesPerSecond = 0;    // smoothed transfer throughput
+
+    // Feeds one finished transfer in, AIMD style: while throughput holds up,
+    // chunk size and window grow by a step; when it drops sharply, both are
+    // halved. Compression is worth its CPU only on slow links, so it follows
+    // the smoothed throughput. Returns false for samples too small to count.
+    bool record(qint64 bytes, qint64 elapsedMs) {
+        if (bytes < minSampleBytes || elapsedMs <= 0) return false;
+        double rate = bytes * 1000.0 / elapsedMs;
+        if (bytesPerSecond <= 0) {
+            bytesPerSecond = rate;
+            return true;
+        }
+        if (rate >= bytesPerSecond * 0.95) {
+            chunkSize = qMin(int(maxChunkSize), chunkSize + chunkStep);
+            inFlight = qMin(int(maxInFlight), inFlight + 1);
+        } else if (rate < bytesPerSecond * 0.7) {
+            chunkSize = qMax(int(minChunkSize), chunkSize / 2);
+            inFlight = qMax(1, inFlight / 2);
+        }
+        bytesPerSecond = 0.7 * bytesPerSecond + 0.3 * rate;
+
+        if (bytesPerSecond < 1024 * 1024 && rttMs > 50) compression = true;
+        else if (bytesPerSecond > 8 * 1024 * 1024) compression = false;
+        return true;
+    }
+};
+
+#endif // TRANSFERTUNING_H